@@ -0,0 +1,85 @@
+#!/bin/bash
+# Distributed crawl check: serves a generated site locally (bench/siteserver), crawls it with one
+# process, then with 2 and 3 processes on loopback (--peers), and checks that rank 0 reports the
+# same total. Then sends a truncated message to a process of a running crawl, which must drop the
+# connection and report the crawl incomplete rather than crash.
+# Settings come from the environment:
+#   PAGES, FANOUT, LATENCY   the site (see bench/siteserver)
+#   SET, THREADS, PORT       what to run, PORT being the site and PORT+1... the processes
+cd "$(dirname "$0")/.."
+
+PAGES=${PAGES:-1000}
+FANOUT=${FANOUT:-10}
+LATENCY=${LATENCY:-2}
+SET=${SET:-3}
+THREADS=${THREADS:-2}
+PORT=${PORT:-8190}
+URL="http://127.0.0.1:$PORT/index.html"
+TMP=$(mktemp -d)
+
+bench/siteserver "$PORT" --pages "$PAGES" --fanout "$FANOUT" --latency "$LATENCY" > /dev/null &
+SERVER=$!
+trap 'kill $SERVER 2> /dev/null; kill $(jobs -p) 2> /dev/null; rm -rf "$TMP"' EXIT
+sleep 0.5
+kill -0 $SERVER 2> /dev/null || exit 1
+
+# Comma separated addresses of n processes
+peers() {
+    local list="" i
+    for ((i = 1; i <= $1; i++)); do
+        list+="${list:+,}127.0.0.1:$((PORT + i))"
+    done
+    echo "$list"
+}
+
+EXPECTED=$(./webcrawler_parallel "$SET" "$URL" "$THREADS" | sed -n 's/^Number of URLs: //p')
+echo "1 process: $EXPECTED URLs"
+FAILED=0
+
+for n in 2 3; do
+    for ((rank = 0; rank < n; rank++)); do
+        ./webcrawler_parallel "$SET" "$URL" "$THREADS" --peers "$(peers $n)" --rank $rank > "$TMP/$rank.out" 2>&1 &
+    done
+    wait $(jobs -p | grep -v "^$SERVER$")
+    total=$(sed -n 's/^Total number of URLs: //p' "$TMP/0.out")
+    parts=$(cat $(seq -f "$TMP/%g.out" 0 $((n - 1))) | awk '/^Number of URLs: / { sum += $4 } END { print sum }')
+    if [ "$total" = "$EXPECTED" ] && [ "$parts" = "$EXPECTED" ]; then
+        echo "$n processes: $total URLs, OK"
+    else
+        echo "$n processes: total ${total:-none}, sum of the processes ${parts:-none}, expected $EXPECTED, FAILED"
+        FAILED=1
+    fi
+done
+
+# A message announcing a URL longer than its payload, sent to rank 1 of a 2 process crawl by a
+# fake rank 0: 'U', payload length 12 (uint32), then URL length 100 and depth 1 (uint32) and only
+# 4 bytes of URL. Rank 1 must drop the connection and report the crawl incomplete.
+if command -v python3 > /dev/null; then
+    python3 - "$SET" "$URL" "$THREADS" "127.0.0.1:$((PORT + 1))" "127.0.0.1:$((PORT + 2))" > "$TMP/1.out" 2>&1 << 'PY'
+import socket, struct, subprocess, sys, time
+crawl_set, url, threads, rank0, rank1 = sys.argv[1:]
+listener = socket.create_server(("127.0.0.1", int(rank0.split(":")[1])))
+crawler = subprocess.Popen(["./webcrawler_parallel", crawl_set, url, threads, "--peers", rank0 + "," + rank1, "--rank", "1"])
+incoming, _ = listener.accept()
+for attempt in range(50):
+    try:
+        out = socket.create_connection(("127.0.0.1", int(rank1.split(":")[1])))
+        break
+    except OSError:
+        time.sleep(0.1)
+out.sendall(struct.pack("<I", 0) + b"U" + struct.pack("<III", 12, 100, 1) + b"abcd")
+try:
+    crawler.wait(timeout=30)
+except subprocess.TimeoutExpired:
+    crawler.kill()
+    print("rank 1 did not stop")
+PY
+    if grep -q "Corrupt URLs from peer" "$TMP/1.out" && grep -q "did not complete" "$TMP/1.out"; then
+        echo "corrupt message: connection dropped, crawl reported incomplete, OK"
+    else
+        echo "corrupt message: FAILED"
+        grep -v "^http" "$TMP/1.out"
+        FAILED=1
+    fi
+fi
+exit $FAILED
@@ -0,0 +1,79 @@
+#!/bin/bash
+# Crawl benchmark: serves a generated site locally (bench/siteserver) and crawls it with both
+# crawlers, every set and every thread count, reporting pages/s, fetch latency and CPU time.
+# Then checks that webcrawler_parallel never has more than --host-concurrency requests at the
+# site at once, from the maximum the site server counts.
+# Settings come from the environment:
+#   PAGES, FANOUT, PAGE_SIZE, LATENCY, JITTER   the site (see bench/siteserver)
+#   SETS, THREADS, PORT, EXTRA                  what to run, EXTRA being options for webcrawler_parallel
+#   LIMITS                                      the --host-concurrency values to check
+cd "$(dirname "$0")/.."
+
+PAGES=${PAGES:-2000}
+FANOUT=${FANOUT:-20}
+PAGE_SIZE=${PAGE_SIZE:-8192}
+LATENCY=${LATENCY:-5}
+JITTER=${JITTER:-5}
+SETS=${SETS:-"0 1 2 3 4"}
+THREADS=${THREADS:-"1 2 4 8"}
+PORT=${PORT:-8090}
+EXTRA=${EXTRA:-}
+LIMITS=${LIMITS:-"1 2 4"}
+URL="http://127.0.0.1:$PORT/index.html"
+
+bench/siteserver "$PORT" --pages "$PAGES" --fanout "$FANOUT" --page-size "$PAGE_SIZE" \
+    --latency "$LATENCY" --jitter "$JITTER" > /dev/null &
+SERVER=$!
+trap 'kill $SERVER 2> /dev/null' EXIT
+sleep 0.5
+kill -0 $SERVER 2> /dev/null || exit 1
+
+echo "Site: $PAGES pages, $FANOUT links and $PAGE_SIZE bytes per page, ${LATENCY}+${JITTER} ms latency"
+printf "%-20s %4s %8s %7s %9s %9s %9s %9s %9s\n" crawler set threads pages seconds pages/s "p50 ms" "p99 ms" "cpu s"
+
+# Run a crawl and print its line of the report
+run() {
+    local name=$1 set=$2 threads=$3
+    shift 3
+    local out times
+    out=$(mktemp)
+    times=$( { TIMEFORMAT='%R %U %S'; time "$@" > "$out" 2>&1; } 2>&1 )
+    read -r real user sys <<< "$times"
+    local pages p50 p99
+    pages=$(sed -n 's/^Number of URLs: //p' "$out")
+    p50=$(sed -n 's/^Fetch latency (ms): p50 \([^ ]*\) p99 \([^ ]*\).*/\1/p' "$out")
+    p99=$(sed -n 's/^Fetch latency (ms): p50 \([^ ]*\) p99 \([^ ]*\).*/\2/p' "$out")
+    rm -f "$out"
+    awk -v n="$name" -v s="$set" -v t="$threads" -v p="${pages:-0}" -v r="$real" -v u="$user" -v y="$sys" \
+        -v a="${p50:-nan}" -v b="${p99:-nan}" \
+        'BEGIN { printf "%-20s %4s %8s %7d %9.3f %9.1f %9s %9s %9.3f\n", n, s, t, p, r, p / r, a, b, u + y }'
+}
+
+for set in $SETS; do
+    run webcrawler "$set" 1 ./webcrawler "$set" "$URL" --fetch-latency
+done
+for set in $SETS; do
+    for threads in $THREADS; do
+        run webcrawler_parallel "$set" "$threads" ./webcrawler_parallel "$set" "$URL" "$threads" --fetch-latency $EXTRA
+    done
+done
+
+echo
+echo "Host concurrency: 8 threads, 300 pages of set 3"
+printf "%-8s %12s %16s\n" limit "max requests" "max connections"
+status=0
+for limit in $LIMITS; do
+    curl -s "http://127.0.0.1:$PORT/_stats/reset" > /dev/null
+    ./webcrawler_parallel 3 "$URL" 8 --host-concurrency "$limit" --max-pages 300 > /dev/null 2>&1
+    stats=$(curl -s "http://127.0.0.1:$PORT/_stats")
+    requests=$(sed -n 's/^max_requests //p' <<< "$stats")
+    connections=$(sed -n 's/^max_connections //p' <<< "$stats")
+    if [ -n "$requests" ] && [ "$requests" -ge 1 ] && [ "$requests" -le "$limit" ]; then
+        result=OK
+    else
+        result=FAILED
+        status=1
+    fi
+    printf "%-8s %12s %16s %s\n" "$limit" "${requests:-?}" "${connections:-?}" "$result"
+done
+exit $status
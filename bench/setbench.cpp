@@ -0,0 +1,99 @@
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <random>
+
+#include "../metrics.cpp"
+#include "../urlarena.cpp"
+#include "../hashtable.cpp"
+
+// Microbenchmarks of the URL sets under contention
+// Threads run a mix of addURL and containsURL on URLs drawn from a fixed pool, so that the
+// lookups hit about as often as a crawler's (most links of a page have already been seen).
+// The list is linear, it gets a smaller pool.
+
+struct Mix {
+    const char* name;
+    int insertPercent;
+};
+
+std::vector<std::string> makeURLs(size_t n) {
+    std::vector<std::string> urls;
+    urls.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        urls.push_back("https://www.example.com/section" + std::to_string(i % 97) + "/page" + std::to_string(i) + ".html");
+    }
+    return urls;
+}
+
+// Millions of operations per second of numThreads threads doing opsPerThread operations each
+template <class S>
+double run(S& set, const std::vector<std::string>& urls, int numThreads, size_t opsPerThread, int insertPercent) {
+    std::atomic<bool> go(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            std::mt19937_64 random(t + 1);
+            while (!go) std::this_thread::yield();
+            for (size_t i = 0; i < opsPerThread; i++) {
+                uint64_t r = random();
+                const std::string& url = urls[r % urls.size()];
+                if ((int) ((r >> 32) % 100) < insertPercent) {
+                    set.addURL(url);
+                } else {
+                    set.containsURL(url);
+                }
+            }
+        });
+    }
+    auto start = std::chrono::steady_clock::now();
+    go = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+    return numThreads * opsPerThread / seconds.count() / 1e6;
+}
+
+template <class S, class Make>
+void bench(const char* name, Make make, const std::vector<std::string>& urls, size_t opsPerThread,
+           const std::vector<int>& threadCounts, const std::vector<Mix>& mixes) {
+    for (const Mix& mix : mixes) {
+        std::cout << std::left << std::setw(20) << name << std::setw(14) << mix.name;
+        for (int numThreads : threadCounts) {
+            S* set = make();
+            std::cout << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+                      << run(*set, urls, numThreads, opsPerThread / numThreads, mix.insertPercent);
+            delete set;
+        }
+        std::cout << std::endl;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    size_t ops = argc > 1 ? std::stoul(argv[1]) : 2000000;
+    std::vector<int> threadCounts{1, 2, 4, 8};
+    std::vector<Mix> mixes{{"insert", 100}, {"50/50", 50}, {"10/90", 10}};
+    std::vector<std::string> urls = makeURLs(200000);
+    std::vector<std::string> fewURLs = makeURLs(2000);
+
+    std::cout << "Millions of operations per second (" << ops << " operations, insert/lookup mix)" << std::endl;
+    std::cout << std::left << std::setw(20) << "set" << std::setw(14) << "mix";
+    for (int numThreads : threadCounts) {
+        std::cout << std::right << std::setw(8) << numThreads << " t";
+    }
+    std::cout << std::endl;
+
+    bench<SetList>("SetList (2k URLs)", []() { return new SetList(); }, fewURLs, ops / 100, threadCounts, mixes);
+    bench<CoarseHashTable<std::string>>("CoarseHashTable", []() { return new CoarseHashTable<std::string>(32); },
+                                        urls, ops, threadCounts, mixes);
+    bench<StripedHashTable<std::string>>("StripedHashTable", []() { return new StripedHashTable<std::string>(32); },
+                                         urls, ops, threadCounts, mixes);
+    bench<LockFreeHashTable>("LockFreeHashTable", []() { return new LockFreeHashTable(1024); },
+                             urls, ops, threadCounts, mixes);
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+// Local stand-in for a website, to benchmark the crawlers reproducibly
+// It serves a generated site of pages /p0.html (also / and /index.html) to /p<pages-1>.html: every
+// page links to the next one, so that the whole site is reachable, and to fanout-1 other pages
+// picked by a hash of its number, and is padded up to about pageSize bytes. Each response can be
+// delayed by latency milliseconds, plus up to jitter more, to stand in for a remote server.
+// One thread per connection, with keep-alive. /robots.txt does not exist (404).
+// /_stats reports the most requests served at once and the most connections open at once since the
+// start or the last /_stats/reset, e.g. to check the per host concurrency limit of a crawler.
+struct SiteConfig {
+    int port = 8080;
+    size_t pages = 1000;
+    size_t fanout = 10;
+    size_t pageSize = 4096;
+    int latency = 0; // milliseconds
+    int jitter = 0;  // milliseconds
+};
+
+SiteConfig config;
+
+// Requests being served and connections open, with their maxima
+std::atomic<int> requests(0), maxRequests(0);
+std::atomic<int> connections(0), maxConnections(0);
+
+void enter(std::atomic<int>& count, std::atomic<int>& max) {
+    int now = ++count;
+    int seen = max;
+    while (now > seen && !max.compare_exchange_weak(seen, now)) {}
+}
+
+uint64_t mix(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return x;
+}
+
+std::string page(size_t i) {
+    std::string html = "<html><head><title>Page " + std::to_string(i) + "</title></head><body>\n";
+    html += "<a href=\"/p" + std::to_string((i + 1) % config.pages) + ".html\">next</a>\n";
+    for (size_t k = 1; k < config.fanout; k++) {
+        size_t j = mix(i * config.fanout + k) % config.pages;
+        html += "<a href=\"/p" + std::to_string(j) + ".html\">page " + std::to_string(j) + "</a>\n";
+    }
+    while (html.size() + 15 < config.pageSize) {
+        html += "<p>Lorem ipsum dolor sit amet, consectetur adipiscing elit.</p>\n";
+    }
+    html += "</body></html>\n";
+    return html;
+}
+
+// Page number of a path, -1 if there is no such page
+long pageOf(const std::string& path) {
+    if (path == "/" || path == "/index.html") return 0;
+    if (path.size() < 8 || path.compare(0, 2, "/p") != 0 || path.compare(path.size() - 5, 5, ".html") != 0) return -1;
+    std::string digits = path.substr(2, path.size() - 7);
+    if (digits.empty() || digits.find_first_not_of("0123456789") != std::string::npos) return -1;
+    size_t i = std::stoul(digits);
+    return i < config.pages ? (long) i : -1;
+}
+
+bool writeAll(int fd, const std::string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        sent += n;
+    }
+    return true;
+}
+
+void serve(int fd) {
+    enter(connections, maxConnections);
+    std::mt19937 random(fd);
+    std::string buffer;
+    char chunk[4096];
+    while (true) {
+        size_t end;
+        while ((end = buffer.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = recv(fd, chunk, sizeof(chunk), 0);
+            if (n <= 0) {
+                connections--;
+                close(fd);
+                return;
+            }
+            buffer.append(chunk, n);
+        }
+        std::string request = buffer.substr(0, end);
+        buffer.erase(0, end + 4);
+        size_t space = request.find(' ');
+        size_t space2 = request.find(' ', space + 1);
+        bool head = request.compare(0, space, "HEAD") == 0;
+        std::string path = space == std::string::npos ? "" : request.substr(space + 1, space2 - space - 1);
+        path = path.substr(0, path.find('?'));
+        if (path == "/_stats" || path == "/_stats/reset") {
+            if (path == "/_stats/reset") {
+                maxRequests = 0;
+                maxConnections = connections.load();
+            }
+            std::string body = "max_requests " + std::to_string(maxRequests) + "\nmax_connections "
+                + std::to_string(maxConnections) + "\n";
+            std::string response = "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nContent-Length: "
+                + std::to_string(body.size()) + "\r\n\r\n" + body;
+            if (!writeAll(fd, response)) {
+                connections--;
+                close(fd);
+                return;
+            }
+            continue;
+        }
+
+        enter(requests, maxRequests);
+        if (config.latency > 0 || config.jitter > 0) {
+            int delay = config.latency + (config.jitter > 0 ? (int) (random() % (config.jitter + 1)) : 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(delay));
+        }
+        long i = pageOf(path);
+        std::string body = i >= 0 ? page(i) : "Not found\n";
+        std::string response = std::string(i >= 0 ? "HTTP/1.1 200 OK" : "HTTP/1.1 404 Not Found")
+            + "\r\nContent-Type: text/html\r\nContent-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+        if (!head) response += body;
+        bool sent = writeAll(fd, response);
+        requests--;
+        if (!sent) {
+            connections--;
+            close(fd);
+            return;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "./siteserver <port> [options]" << std::endl;
+        std::cerr << "options being any of:" << std::endl;
+        std::cerr << "\t--pages <n>\t\t number of pages of the site (default 1000)" << std::endl;
+        std::cerr << "\t--fanout <n>\t\t number of links of a page (default 10)" << std::endl;
+        std::cerr << "\t--page-size <bytes>\t size of a page (default 4096)" << std::endl;
+        std::cerr << "\t--latency <ms>\t\t delay of every response (default 0)" << std::endl;
+        std::cerr << "\t--jitter <ms>\t\t random extra delay of up to ms (default 0)" << std::endl;
+        return 1;
+    }
+    config.port = std::stoi(argv[1]);
+    for (int i = 2; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--pages" && i + 1 < argc) {
+            config.pages = std::max(std::stoul(argv[++i]), 1UL);
+        } else if (option == "--fanout" && i + 1 < argc) {
+            config.fanout = std::max(std::stoul(argv[++i]), 1UL);
+        } else if (option == "--page-size" && i + 1 < argc) {
+            config.pageSize = std::stoul(argv[++i]);
+        } else if (option == "--latency" && i + 1 < argc) {
+            config.latency = std::stoi(argv[++i]);
+        } else if (option == "--jitter" && i + 1 < argc) {
+            config.jitter = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = htons(config.port);
+    if (bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 1024) != 0) {
+        std::cerr << "Failed to listen on port " << config.port << std::endl;
+        return 1;
+    }
+    std::cout << "Serving " << config.pages << " pages on http://127.0.0.1:" << config.port << "/" << std::endl;
+
+    while (true) {
+        int fd = accept(listener, nullptr, nullptr);
+        if (fd < 0) continue;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        std::thread(serve, fd).detach();
+    }
+}
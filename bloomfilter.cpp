@@ -0,0 +1,67 @@
+#include <string>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
+
+// Concurrent Bloom filter over the URL fingerprints (see urlFingerprint in urlarena.cpp)
+// It answers "definitely not seen" without any lock, so the exact set only has to be looked up
+// (under its lock) when the filter says a URL was probably seen. Blocked layout: all the bits
+// of a URL live in one 64 bytes block, so a check or an insertion touches a single cache line.
+// Bits are only ever set, with relaxed atomics: a check racing with the insertion of the same
+// URL can still answer "not seen", so the exact set keeps the last word on duplicates.
+class BloomFilter {
+private:
+    static const size_t BLOCK_WORDS = 8; // 512 bits
+    static const int NUM_HASHES = 7;
+    static const size_t BITS_PER_URL = 10; // About 1% false positives with 7 hashes
+
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    size_t numBlocks;
+
+    std::atomic<uint64_t>* blockFor(uint64_t fp) const {
+        return &words[(size_t) (((fp >> 32) * numBlocks) >> 32) * BLOCK_WORDS];
+    }
+
+    // Next bit of the block for a URL, from a multiplicative sequence seeded by its fingerprint
+    static unsigned nextBit(uint64_t& h) {
+        h = h * 0x9E3779B97F4A7C15ULL + 0x632BE59BD9B4E019ULL;
+        return (unsigned) (h >> 55);
+    }
+
+public:
+    // Sized for expected URLs, more of them only raise the false positive rate
+    explicit BloomFilter(size_t expected) {
+        size_t bits = std::max<size_t>(expected, 1024) * BITS_PER_URL;
+        numBlocks = std::min<size_t>((bits + 511) / 512, (size_t) 1 << 32);
+        words.reset(new std::atomic<uint64_t>[numBlocks * BLOCK_WORDS]);
+        for (size_t i = 0; i < numBlocks * BLOCK_WORDS; i++) {
+            words[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void add(const std::string& url) {
+        uint64_t fp = urlFingerprint(url);
+        std::atomic<uint64_t>* block = blockFor(fp);
+        for (int i = 0; i < NUM_HASHES; i++) {
+            unsigned bit = nextBit(fp);
+            uint64_t mask = 1ULL << (bit & 63);
+            if (!(block[bit >> 6].load(std::memory_order_relaxed) & mask)) {
+                block[bit >> 6].fetch_or(mask, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // false if url was definitely never added, true if it probably was
+    bool mayContain(const std::string& url) const {
+        uint64_t fp = urlFingerprint(url);
+        const std::atomic<uint64_t>* block = blockFor(fp);
+        for (int i = 0; i < NUM_HASHES; i++) {
+            unsigned bit = nextBit(fp);
+            if (!(block[bit >> 6].load(std::memory_order_relaxed) & (1ULL << (bit & 63)))) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,158 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+
+// Crawl journal, to checkpoint a crawl and resume it
+// Every URL added to the set is recorded ('A', length, depth, URL), and so is the end of its processing
+// ('D', fingerprint) once all its links have been added. The links of a page being recorded before
+// its end, any prefix of the journal is a consistent state of the crawl: the URLs found are the ones
+// recorded and the frontier the ones not finished. Workers only append to a buffer in memory which a
+// background thread writes out every interval, so a crash only loses the pages of the last interval,
+// which are fetched again on resume.
+// Resuming compacts the journal: it is rewritten (to a temporary file renamed over it) as a snapshot
+// of the crawl, every URL finished as ('F', length, URL) and every URL of the frontier as an 'A'
+// record, so that a journal does not keep the whole history of the crawl across resumes.
+class CrawlJournal {
+private:
+    std::ofstream out;
+    bool opened;
+    std::string buffer;
+    std::mutex lock;
+    std::condition_variable condition;
+    bool stopping;
+    std::chrono::milliseconds interval;
+    std::thread writer;
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            condition.wait_for(guard, interval, [this]() { return stopping; });
+            std::string batch;
+            batch.swap(buffer);
+            bool last = stopping;
+            guard.unlock();
+            if (!opened) return;
+            out.write(batch.data(), batch.size());
+            out.flush();
+            if (!out) {
+                std::cerr << "Failed to write the crawl journal" << std::endl;
+            }
+            guard.lock();
+            if (last) return;
+        }
+    }
+
+public:
+    // Start a new journal, or continue an existing one with append
+    CrawlJournal(const std::string& path, std::chrono::milliseconds interval, bool append)
+        : out(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc)), opened((bool) out),
+          stopping(false), interval(interval) {
+        if (!opened) {
+            std::cerr << "Failed to open the crawl journal " << path << std::endl;
+        }
+        writer = std::thread(&CrawlJournal::run, this);
+    }
+
+    // Writes what is left
+    ~CrawlJournal() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            condition.notify_one();
+        }
+        writer.join();
+    }
+
+    bool isOpen() const {
+        return opened;
+    }
+
+    // url was added to the set, found at depth
+    void added(const std::string& url, uint32_t depth) {
+        uint32_t length = (uint32_t) url.size();
+        std::lock_guard<std::mutex> guard(lock);
+        buffer.push_back('A');
+        buffer.append((const char*) &length, sizeof(length));
+        buffer.append((const char*) &depth, sizeof(depth));
+        buffer.append(url);
+    }
+
+    // All the links of url have been added
+    void finished(const std::string& url) {
+        uint64_t fp = urlFingerprint(url);
+        std::lock_guard<std::mutex> guard(lock);
+        buffer.push_back('D');
+        buffer.append((const char*) &fp, sizeof(fp));
+    }
+
+    // Replay a journal: onAdded gets every URL found, frontier the unfinished ones in the order
+    // they were found. The journal is then compacted, which also drops a record cut by a crash (its
+    // length is checked against the rest of the file before anything is allocated).
+    // false if it cannot be read or rewritten.
+    static bool load(const std::string& path, const std::function<void(const std::string&)>& onAdded,
+                     std::vector<FrontierEntry>& frontier) {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) {
+            std::cerr << "Failed to open the crawl journal " << path << std::endl;
+            return false;
+        }
+        std::streamoff end = in.tellg();
+        in.seekg(0);
+        std::vector<FrontierEntry> found; // In the order they were found
+        std::vector<bool> done;
+        std::unordered_map<uint64_t, size_t> index; // Fingerprint -> position in found
+        char type;
+        while (in.get(type)) {
+            if (type == 'A' || type == 'F') {
+                uint32_t length;
+                if (!in.read((char*) &length, sizeof(length))) break;
+                std::streamoff left = end - (std::streamoff) in.tellg() - (type == 'A' ? sizeof(uint32_t) : 0);
+                if ((std::streamoff) length > left) break;
+                FrontierEntry entry{std::string(length, '\0'), 0};
+                if ((type == 'A' && !in.read((char*) &entry.depth, sizeof(entry.depth))) || !in.read(&entry.url[0], length)) break;
+                if (!index.emplace(urlFingerprint(entry.url), found.size()).second) continue;
+                onAdded(entry.url);
+                found.push_back(std::move(entry));
+                done.push_back(type == 'F');
+            } else if (type == 'D') {
+                uint64_t fp;
+                if (!in.read((char*) &fp, sizeof(fp))) break;
+                auto it = index.find(fp);
+                if (it != index.end()) done[it->second] = true;
+            } else {
+                break;
+            }
+        }
+        in.close();
+
+        std::string temporary = path + ".tmp";
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        for (size_t i = 0; i < found.size(); i++) {
+            const FrontierEntry& entry = found[i];
+            uint32_t length = (uint32_t) entry.url.size();
+            out.put(done[i] ? 'F' : 'A');
+            out.write((const char*) &length, sizeof(length));
+            if (!done[i]) out.write((const char*) &entry.depth, sizeof(entry.depth));
+            out.write(entry.url.data(), length);
+        }
+        out.close();
+        if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::cerr << "Failed to compact the crawl journal " << path << std::endl;
+            return false;
+        }
+
+        for (size_t i = 0; i < found.size(); i++) {
+            if (!done[i]) frontier.push_back(std::move(found[i]));
+        }
+        return true;
+    }
+};
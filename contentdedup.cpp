@@ -0,0 +1,194 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_set>
+#include <unordered_map>
+#include <algorithm>
+#include <mutex>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+
+// Hash of a body fed in pieces, 8 bytes at a time: the same whatever the pieces (see ContentDedup::contentHash)
+class ContentHasher {
+private:
+    uint64_t h;
+    size_t size;
+    char pending[8]; // Bytes of the next word
+    size_t numPending;
+
+    static uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    void word(const char* bytes) {
+        uint64_t w;
+        memcpy(&w, bytes, sizeof(w));
+        w *= 0x87c37b91114253d5ULL;
+        h ^= rotl(w, 31) * 0x4cf5ad432745937fULL;
+        h = rotl(h, 27) * 5 + 0x52dce729;
+    }
+
+public:
+    ContentHasher() : h(14695981039346656037ULL), size(0), numPending(0) {}
+
+    void update(const char* data, size_t length) {
+        size += length;
+        if (numPending > 0) {
+            size_t n = std::min(length, sizeof(pending) - numPending);
+            memcpy(pending + numPending, data, n);
+            numPending += n;
+            data += n;
+            length -= n;
+            if (numPending < sizeof(pending)) return;
+            word(pending);
+            numPending = 0;
+        }
+        for (; length >= sizeof(pending); data += sizeof(pending), length -= sizeof(pending)) {
+            word(data);
+        }
+        memcpy(pending, data, length);
+        numPending = length;
+    }
+
+    // Number of bytes hashed
+    size_t bytes() const {
+        return size;
+    }
+
+    uint64_t finish() const {
+        return finishHash(hashBytes(h ^ size, std::string_view(pending, numPending)));
+    }
+};
+
+// Content deduplication, to skip the links of pages already seen under another URL (needs urlarena.cpp)
+// A page is an exact duplicate when the hash of its body was seen before, and a near duplicate when
+// the SimHash of its body is within maxDistance bits of one seen before (Charikar; the index is the
+// one of Manku et al., "Detecting Near-Duplicates for Web Crawling"): the 64 bits are cut in
+// maxDistance + 1 blocks, two fingerprints that close agree on at least one block, so each block
+// keys a table and only the fingerprints sharing a block with the page are compared. The features
+// of the SimHash are the distinct shingles of 3 words of the page, markup included so that pages
+// differing only by their links are told apart. Tables are split in stripes, each with its lock.
+class ContentDedup {
+private:
+    static const size_t NUM_STRIPES = 64;
+    static const int SHINGLE = 3;
+
+    struct Stripe {
+        std::mutex lock;
+        std::unordered_set<uint64_t> hashes;                           // Exact table
+        std::unordered_map<uint64_t, std::vector<uint64_t>> fingerprints; // Block table: block -> SimHashes
+    };
+
+    int maxDistance;
+    std::unique_ptr<Stripe[]> exact;
+    std::vector<std::unique_ptr<Stripe[]>> blocks; // One table per block
+
+    static uint64_t rotl(uint64_t x, int r) {
+        return (x << r) | (x >> (64 - r));
+    }
+
+    static bool isWordChar(unsigned char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80;
+    }
+
+    // Bits of block i of a fingerprint
+    uint64_t blockOf(uint64_t fp, int i) const {
+        int first = i * 64 / (maxDistance + 1);
+        int last = (i + 1) * 64 / (maxDistance + 1);
+        return last - first == 64 ? fp : (fp >> first) & ((1ULL << (last - first)) - 1);
+    }
+
+    static Stripe& stripeOf(std::unique_ptr<Stripe[]>& table, uint64_t key) {
+        return table[finishHash(key) % NUM_STRIPES];
+    }
+
+public:
+    // Pages within maxDistance bits (0 to 7) of a page seen are near duplicates, 0 for exact duplicates only
+    explicit ContentDedup(int maxDistance) : maxDistance(maxDistance), exact(new Stripe[NUM_STRIPES]) {
+        if (maxDistance > 0) {
+            for (int i = 0; i <= maxDistance; i++) {
+                blocks.emplace_back(new Stripe[NUM_STRIPES]);
+            }
+        }
+    }
+
+    // Hash of a whole body, 8 bytes at a time
+    static uint64_t contentHash(std::string_view body) {
+        ContentHasher hasher;
+        hasher.update(body.data(), body.size());
+        return hasher.finish();
+    }
+
+    // SimHash of the distinct shingles of words of a body (words are lowercased runs of letters and digits)
+    static uint64_t simHash(std::string_view body) {
+        std::vector<uint64_t> features;
+        uint64_t words[SHINGLE] = {0};
+        size_t numWords = 0;
+        for (size_t i = 0; i < body.size(); ) {
+            while (i < body.size() && !isWordChar(body[i])) i++;
+            if (i == body.size()) break;
+            uint64_t h = 14695981039346656037ULL;
+            for (; i < body.size() && isWordChar(body[i]); i++) {
+                unsigned char c = body[i];
+                h ^= c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+                h *= 1099511628211ULL;
+            }
+            words[numWords++ % SHINGLE] = h;
+            if (numWords >= SHINGLE) {
+                uint64_t f = 0;
+                for (int k = 0; k < SHINGLE; k++) {
+                    f = rotl(f, 21) ^ words[(numWords + k) % SHINGLE];
+                }
+                features.push_back(finishHash(f));
+            }
+        }
+        if (features.empty() && numWords > 0) features.push_back(finishHash(words[0]));
+        std::sort(features.begin(), features.end());
+        features.erase(std::unique(features.begin(), features.end()), features.end());
+
+        int counts[64] = {0};
+        for (uint64_t f : features) {
+            for (int b = 0; b < 64; b++) {
+                counts[b] += (f >> b) & 1 ? 1 : -1;
+            }
+        }
+        uint64_t fp = 0;
+        for (int b = 0; b < 64; b++) {
+            if (counts[b] > 0) fp |= 1ULL << b;
+        }
+        return fp;
+    }
+
+    // Whether body duplicates a page seen before, otherwise remember it
+    // Two copies of a page checked at the same time are told apart by the exact table, two near
+    // duplicates may both pass.
+    bool duplicate(std::string_view body) {
+        uint64_t hash = contentHash(body);
+        {
+            Stripe& stripe = stripeOf(exact, hash);
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            if (!stripe.hashes.insert(hash).second) return true;
+        }
+        if (blocks.empty()) return false;
+
+        uint64_t fp = simHash(body);
+        for (int i = 0; i <= maxDistance; i++) {
+            uint64_t key = blockOf(fp, i);
+            Stripe& stripe = stripeOf(blocks[i], key);
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            auto it = stripe.fingerprints.find(key);
+            if (it == stripe.fingerprints.end()) continue;
+            for (uint64_t other : it->second) {
+                if (__builtin_popcountll(fp ^ other) <= maxDistance) return true;
+            }
+        }
+        for (int i = 0; i <= maxDistance; i++) {
+            uint64_t key = blockOf(fp, i);
+            Stripe& stripe = stripeOf(blocks[i], key);
+            std::lock_guard<std::mutex> guard(stripe.lock);
+            stripe.fingerprints[key].push_back(fp);
+        }
+        return false;
+    }
+};
@@ -0,0 +1,540 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <iostream>
+#include <curl/curl.h>
+
+// User agent sent with every request, its product token is the one looked for in robots.txt
+const char* USER_AGENT = "Parallel-Web-Crawler/1.0";
+const char* ROBOTS_AGENT = "parallel-web-crawler";
+
+// Transfer settings shared by every fetch of the process (set by main before crawling)
+struct FetchConfig {
+    bool http2 = false; // Negotiate HTTP/2 and multiplex the transfers to a host on one connection
+    bool latencies = false; // Record the duration of every transfer
+    bool htmlOnly = true; // Abandon the pages whose Content-Type is not HTML
+    curl_off_t maxBytes = 10 << 20; // Abandon the pages larger than this (decompressed), 0 for no limit
+};
+
+FetchConfig fetchConfig;
+
+// Durations of the successful transfers, recorded when fetchConfig.latencies is set
+class FetchLatencies {
+private:
+    std::mutex lock;
+    std::vector<curl_off_t> micros;
+
+public:
+    void record(CURL* curl) {
+        curl_off_t total;
+        if (curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total) != CURLE_OK) return;
+        std::lock_guard<std::mutex> guard(lock);
+        micros.push_back(total);
+    }
+
+    // Print the median and 99th percentile
+    void report(std::ostream& out) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (micros.empty()) {
+            out << "Fetch latency: no fetch" << std::endl;
+            return;
+        }
+        std::sort(micros.begin(), micros.end());
+        out << "Fetch latency (ms): p50 " << micros[micros.size() / 2] / 1000.0
+            << " p99 " << micros[(micros.size() - 1) * 99 / 100] / 1000.0
+            << " over " << micros.size() << " fetches" << std::endl;
+    }
+};
+
+FetchLatencies fetchLatencies;
+
+// Why a page was abandoned before the end of its transfer
+enum SkipReason {
+    NOT_SKIPPED,
+    SKIPPED_NOT_HTML,  // Content-Type of another media type than HTML
+    SKIPPED_TOO_LARGE, // Content-Length of an uncompressed response, or decompressed body, over fetchConfig.maxBytes
+};
+
+const char* skipReasonName(SkipReason reason) {
+    static const char* names[] = {"", "not_html", "too_large"};
+    return names[reason];
+}
+
+// Validators of a response, to fetch the page again only if it changed (empty when not sent)
+struct Validators {
+    std::string etag;
+    std::string lastModified;
+};
+
+// What is known of a transfer once it is over
+struct FetchResult {
+    long status = 0;      // HTTP status, 0 if the transfer failed
+    curl_off_t bytes = 0; // Size of the body
+    double seconds = 0;   // Duration of the transfer
+    SkipReason skipped = NOT_SKIPPED; // The page was abandoned (its body is then empty)
+    Validators validators; // Of the response of a page
+};
+
+// Fill result from a finished transfer and count it in the metrics
+// A transfer which is not a page of the crawl (page false, e.g. robots.txt) is only counted as OTHER_FETCHES.
+void recordTransfer(CURL* curl, CURLcode code, FetchResult& result, bool page = true) {
+    curl_off_t micros = 0;
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &micros);
+    result.seconds = micros / 1e6;
+    if (!page) {
+        if (code == CURLE_OK) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+            curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &result.bytes);
+        } else {
+            result.status = 0;
+        }
+        metrics.add(OTHER_FETCHES);
+        return;
+    }
+    if (result.skipped != NOT_SKIPPED) {
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+        curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &result.bytes);
+        metrics.add(result.skipped == SKIPPED_NOT_HTML ? SKIPPED_NOT_HTML_PAGES : SKIPPED_TOO_LARGE_PAGES);
+        metrics.add(BYTES_FETCHED, result.bytes);
+        return;
+    }
+    if (code != CURLE_OK) {
+        result.status = 0;
+        // std::cerr << "Failed to fetch URL: " << curl_easy_strerror(code) << std::endl;
+        metrics.add(FETCH_ERRORS);
+        metrics.curlError(code);
+        return;
+    }
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result.status);
+    curl_easy_getinfo(curl, CURLINFO_SIZE_DOWNLOAD_T, &result.bytes);
+    metrics.add(PAGES_FETCHED);
+    metrics.add(BYTES_FETCHED, result.bytes);
+    metrics.httpStatus(result.status);
+    if (fetchConfig.latencies) fetchLatencies.record(curl);
+}
+
+// Callback function to receive HTTP response
+size_t writeCallback(char* ptr, size_t size, size_t nmemb, std::string* data) {
+    data->append(ptr, size * nmemb);
+    return size * nmemb;
+}
+
+// DNS cache, TLS sessions and connection pool shared by every handle of the process, so that the
+// thread-local handles and the loops of the Fetcher reuse each other's connections to a host
+// instead of each opening its own (HTTP/2 streams are still only multiplexed within one loop)
+static std::mutex shareLocks[CURL_LOCK_DATA_LAST];
+
+static void lockShare(CURL*, curl_lock_data data, curl_lock_access, void*) {
+    shareLocks[data].lock();
+}
+
+static void unlockShare(CURL*, curl_lock_data data, void*) {
+    shareLocks[data].unlock();
+}
+
+CURLSH* curlShare() {
+    static CURLSH* share = []() {
+        CURLSH* sh = curl_share_init();
+        curl_share_setopt(sh, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(sh, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+        curl_share_setopt(sh, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+        return sh;
+    }();
+    return share;
+}
+
+// Options common to every transfer
+void setCommonOptions(CURL* curl) {
+    curl_easy_setopt(curl, CURLOPT_SHARE, curlShare());
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, ""); // Every encoding libcurl decodes (gzip, brotli, zstd...)
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); // Follow redirects
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    if (fetchConfig.http2) {
+        curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long) CURL_HTTP_VERSION_2TLS);
+        curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L); // Wait for a connection to multiplex on rather than open one
+    }
+}
+
+// Easy handle of the calling thread, reset but keeping its open connections between calls
+CURL* threadHandle() {
+    struct Handle {
+        CURL* curl;
+        Handle() : curl(curl_easy_init()) {}
+        ~Handle() { if (curl) curl_easy_cleanup(curl); }
+    };
+    static thread_local Handle handle;
+    if (handle.curl) {
+        curl_easy_reset(handle.curl);
+        setCommonOptions(handle.curl);
+    }
+    return handle.curl;
+}
+
+// Function to check if URL exists
+bool urlExists(const std::string& url) {
+    CURL* curl = threadHandle();
+    long response_code = 0;
+
+    if(curl) {
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L); // We don't need the body
+
+        CURLcode res = curl_easy_perform(curl);
+        metrics.add(OTHER_FETCHES);
+
+        if(res == CURLE_OK) {
+            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
+            return response_code == 200;
+        }
+    }
+    return false;
+}
+
+// Called with each chunk of the body as it arrives
+typedef std::function<void(const char* data, size_t size)> DataCallback;
+
+// A page being downloaded
+// Its headers are checked as they arrive and its body as it grows, so that what cannot hold links
+// (images, archives, PDFs...) or is too large is abandoned before being downloaded.
+// With the validators of a previous response, the request is conditional (304 if not modified).
+struct PageDownload {
+    std::string body;
+    FetchResult result;
+    DataCallback onData; // If given, gets the chunks of the body while they arrive
+    bool keepBody = true;
+    curl_off_t received = 0;
+    curl_off_t contentLength = -1; // Of the current response, -1 if not given
+    bool encoded = false; // The current response has a Content-Encoding: its Content-Length is the compressed size
+    Validators conditional;
+    curl_slist* headers = nullptr; // Request headers, alive until the end of the transfer
+
+    PageDownload() = default;
+    PageDownload(const PageDownload&) = delete;
+    ~PageDownload() { curl_slist_free_all(headers); }
+};
+
+static bool equalsLower(std::string_view s, std::string_view lowerCase) {
+    if (s.size() != lowerCase.size()) return false;
+    for (size_t i = 0; i < s.size(); i++) {
+        if (tolower((unsigned char) s[i]) != lowerCase[i]) return false;
+    }
+    return true;
+}
+
+static std::string_view trim(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r' || s.back() == '\n')) s.remove_suffix(1);
+    return s;
+}
+
+// Header callback: every response (one per redirect) starts with its status line, and only the
+// headers of a successful one are checked. Returning 0 aborts the transfer. The Content-Length is
+// only a pre-filter, checked at the end of the headers for a response without Content-Encoding;
+// writePage checks the decompressed size of every body.
+static size_t pageHeader(char* buffer, size_t size, size_t nitems, PageDownload* p) {
+    size_t n = size * nitems;
+    std::string_view line(buffer, n);
+    if (line.compare(0, 5, "HTTP/") == 0) {
+        size_t space = line.find(' ');
+        p->result.status = space == std::string_view::npos ? 0 : atol(std::string(line.substr(space + 1, 3)).c_str());
+        p->result.validators = Validators();
+        p->contentLength = -1;
+        p->encoded = false;
+        return n;
+    }
+    size_t colon = line.find(':');
+    if (colon == std::string_view::npos) {
+        if (trim(line).empty() && p->result.status >= 200 && p->result.status < 300 && !p->encoded
+            && fetchConfig.maxBytes > 0 && p->contentLength > fetchConfig.maxBytes) {
+            p->result.skipped = SKIPPED_TOO_LARGE;
+            return 0;
+        }
+        return n;
+    }
+    std::string_view name = line.substr(0, colon);
+    std::string_view value = trim(line.substr(colon + 1));
+    if (equalsLower(name, "etag")) {
+        p->result.validators.etag = value;
+    } else if (equalsLower(name, "last-modified")) {
+        p->result.validators.lastModified = value;
+    }
+    if (p->result.status < 200 || p->result.status >= 300) return n;
+    if (fetchConfig.htmlOnly && equalsLower(name, "content-type")) {
+        std::string_view type = trim(value.substr(0, value.find(';')));
+        if (!equalsLower(type, "text/html") && !equalsLower(type, "application/xhtml+xml")) {
+            p->result.skipped = SKIPPED_NOT_HTML;
+            return 0;
+        }
+    } else if (equalsLower(name, "content-length")) {
+        p->contentLength = atoll(std::string(value).c_str());
+    } else if (equalsLower(name, "content-encoding") && !value.empty() && !equalsLower(value, "identity")) {
+        p->encoded = true;
+    }
+    return n;
+}
+
+static size_t writePage(char* ptr, size_t size, size_t nmemb, PageDownload* p) {
+    size_t n = size * nmemb;
+    p->received += n;
+    if (fetchConfig.maxBytes > 0 && p->received > fetchConfig.maxBytes) {
+        p->result.skipped = SKIPPED_TOO_LARGE;
+        return 0;
+    }
+    if (p->onData) p->onData(ptr, n);
+    if (p->keepBody) p->body.append(ptr, n);
+    return n;
+}
+
+// Options of a page transfer into p
+void setPageOptions(CURL* curl, const std::string& url, PageDownload* p) {
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writePage);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, p);
+    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, pageHeader);
+    curl_easy_setopt(curl, CURLOPT_HEADERDATA, p);
+    if (!p->conditional.etag.empty()) {
+        p->headers = curl_slist_append(p->headers, ("If-None-Match: " + p->conditional.etag).c_str());
+    }
+    if (!p->conditional.lastModified.empty()) {
+        p->headers = curl_slist_append(p->headers, ("If-Modified-Since: " + p->conditional.lastModified).c_str());
+    }
+    if (p->headers) curl_easy_setopt(curl, CURLOPT_HTTPHEADER, p->headers);
+}
+
+// Function to fetch a page, abandoning it if it is not HTML or too large (see PageDownload), and
+// only if it was modified since the response of conditional if given (304 and no body otherwise)
+// result gets the status, size and duration of the transfer, and why it was abandoned
+std::string fetchPage(const std::string& url, FetchResult& result, const Validators& conditional = Validators()) {
+    CURL* curl = threadHandle();
+    result = FetchResult();
+    if (!curl) {
+        std::cerr << "Failed to initialize CURL" << std::endl;
+        return "";
+    }
+    PageDownload page;
+    page.conditional = conditional;
+    setPageOptions(curl, url, &page);
+    CURLcode res = curl_easy_perform(curl);
+    recordTransfer(curl, res, page.result);
+    result = page.result;
+    if (res != CURLE_OK) {
+        return ""; // Return empty string to indicate failure
+    }
+    return std::move(page.body);
+}
+
+// Function to fetch HTML content from a URL, result gets the status, size and duration of the transfer
+// Not counted as a page of the crawl (see recordTransfer), pages go through fetchPage.
+std::string fetchHTML(const std::string& url, FetchResult& result) {
+    CURL* curl = threadHandle();
+    result = FetchResult();
+    if (curl) {
+        std::string data;
+        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+        CURLcode res = curl_easy_perform(curl);
+        recordTransfer(curl, res, result, false);
+        if (res != CURLE_OK) {
+            return ""; // Return empty string to indicate failure
+        }
+        return data;
+    } else {
+        std::cerr << "Failed to initialize CURL" << std::endl;
+        return "";
+    }
+}
+
+// Same, status gets the HTTP status code (0 on failure)
+std::string fetchHTML(const std::string& url, long& status) {
+    FetchResult result;
+    std::string data = fetchHTML(url, result);
+    status = result.status;
+    return data;
+}
+
+std::string fetchHTML(const std::string& url) {
+    FetchResult result;
+    return fetchHTML(url, result);
+}
+
+// Called with the body of a fetched page, or an empty string if the fetch failed
+// (same convention as fetchHTML), and the result of the transfer; the callee may move the body out
+typedef std::function<void(std::string& html, const FetchResult& result)> FetchCallback;
+
+// Asynchronous fetch engine
+// Each event loop thread drives a curl multi handle holding up to maxInFlight transfers at once,
+// so a handful of threads keep hundreds of requests waiting on the network. Callbacks run on the
+// loop thread and should only hand the body over (e.g. queue the parsing on the ThreadPool).
+// Easy handles are recycled, and the multi handle keeps the connections open between transfers.
+// Pages are checked like by fetchPage.
+class Fetcher {
+private:
+    struct Transfer : PageDownload {
+        std::string url;
+        FetchCallback done;
+    };
+
+    struct Loop {
+        CURLM* multi;
+        std::thread thread;
+        std::mutex pendingMutex;
+        std::deque<Transfer*> pending;
+        size_t inFlight; // only used by the loop thread
+        std::vector<CURL*> idle; // finished easy handles to reuse, only used by the loop thread
+    };
+
+    std::vector<std::unique_ptr<Loop>> loops;
+    std::atomic<size_t> nextLoop;
+    std::atomic<bool> stopping;
+    size_t maxInFlight;
+
+    bool start(Loop& loop, Transfer* t);
+    void finish(Loop& loop, CURLMsg* msg);
+    void run(Loop& loop);
+
+public:
+    Fetcher(size_t numLoops, size_t maxInFlight);
+    ~Fetcher();
+    void fetch(const std::string& url, const FetchCallback& done,
+               const DataCallback& onData = nullptr, bool keepBody = true, const Validators& conditional = Validators());
+};
+
+Fetcher::Fetcher(size_t numLoops, size_t maxInFlight) : nextLoop(0), stopping(false), maxInFlight(maxInFlight) {
+    for (size_t i = 0; i < numLoops; ++i) {
+        std::unique_ptr<Loop> loop(new Loop());
+        loop->multi = curl_multi_init();
+        if (fetchConfig.http2) {
+            curl_multi_setopt(loop->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        }
+        loop->inFlight = 0;
+        loops.push_back(std::move(loop));
+    }
+    for (auto& loop : loops) {
+        loop->thread = std::thread(&Fetcher::run, this, std::ref(*loop));
+    }
+}
+
+// Finishes the pending and in flight transfers before returning
+Fetcher::~Fetcher() {
+    stopping = true;
+    for (auto& loop : loops) {
+        curl_multi_wakeup(loop->multi);
+    }
+    for (auto& loop : loops) {
+        loop->thread.join();
+        for (CURL* curl : loop->idle) {
+            curl_easy_cleanup(curl);
+        }
+        curl_multi_cleanup(loop->multi);
+    }
+}
+
+// Queue a URL, done is called from a loop thread once the transfer is over
+// If given, onData gets the chunks of the body while they arrive (then done gets an
+// empty body unless keepBody), so the page can be parsed during the download
+// With conditional, the page is only downloaded if it was modified since that response
+void Fetcher::fetch(const std::string& url, const FetchCallback& done, const DataCallback& onData, bool keepBody,
+                    const Validators& conditional) {
+    Loop& loop = *loops[nextLoop++ % loops.size()];
+    {
+        std::lock_guard<std::mutex> lock(loop.pendingMutex);
+        Transfer* t = new Transfer();
+        t->url = url;
+        t->done = done;
+        t->onData = onData;
+        t->keepBody = keepBody || !onData;
+        t->conditional = conditional;
+        loop.pending.push_back(t);
+    }
+    curl_multi_wakeup(loop.multi);
+}
+
+// Add the transfer to the loop, false if no handle could be made for it (pending lock held, so the
+// caller calls done once it is released: done may fetch again)
+bool Fetcher::start(Loop& loop, Transfer* t) {
+    CURL* curl;
+    if (!loop.idle.empty()) {
+        curl = loop.idle.back();
+        loop.idle.pop_back();
+        curl_easy_reset(curl);
+    } else {
+        curl = curl_easy_init();
+    }
+    if (!curl) {
+        std::cerr << "Failed to initialize CURL" << std::endl;
+        return false;
+    }
+    setCommonOptions(curl);
+    setPageOptions(curl, t->url, t);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    curl_multi_add_handle(loop.multi, curl);
+    loop.inFlight++;
+    return true;
+}
+
+void Fetcher::finish(Loop& loop, CURLMsg* msg) {
+    CURL* curl = msg->easy_handle;
+    Transfer* t = nullptr;
+    curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char**) &t);
+    recordTransfer(curl, msg->data.result, t->result);
+    if (msg->data.result != CURLE_OK) {
+        t->body.clear(); // Empty string to indicate failure
+    }
+    curl_multi_remove_handle(loop.multi, curl);
+    loop.idle.push_back(curl);
+    loop.inFlight--;
+    t->done(t->body, t->result);
+    delete t;
+}
+
+void Fetcher::run(Loop& loop) {
+    while (true) {
+        std::vector<Transfer*> failed;
+        bool over;
+        {
+            std::lock_guard<std::mutex> lock(loop.pendingMutex);
+            while (loop.inFlight < maxInFlight && !loop.pending.empty()) {
+                Transfer* t = loop.pending.front();
+                loop.pending.pop_front();
+                if (!start(loop, t)) failed.push_back(t);
+            }
+            over = stopping && loop.pending.empty() && loop.inFlight == 0;
+        }
+        for (Transfer* t : failed) {
+            t->done(t->body, t->result);
+            delete t;
+        }
+        if (over && failed.empty()) {
+            return;
+        }
+        int running = 0;
+        curl_multi_perform(loop.multi, &running);
+        CURLMsg* msg;
+        int left = 0;
+        bool finished = false;
+        while ((msg = curl_multi_info_read(loop.multi, &left))) {
+            if (msg->msg == CURLMSG_DONE) {
+                finish(loop, msg);
+                finished = true;
+            }
+        }
+        // Sleep until a socket is ready, a transfer times out or fetch() wakes us up,
+        // unless transfers just finished and pending ones can take their place
+        if (!finished) {
+            curl_multi_poll(loop.multi, nullptr, 0, 1000, nullptr);
+        }
+    }
+}
@@ -0,0 +1,273 @@
+#include <string>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdint>
+
+// A URL waiting to be fetched, with its depth (number of links followed from the seed to reach it)
+struct FrontierEntry {
+    std::string url;
+    uint32_t depth;
+};
+
+// FIFO of URLs keeping about window of them in memory, for frontiers larger than RAM
+// Once the window is full, the newest URLs are gathered in batches of window / 2 and appended to
+// segment files (length and depth prefixed records). When the URLs in memory have all been taken, the
+// oldest segment is read back and deleted, so URLs still come out in the order they went in.
+// Without a path prefix (or with a 0 window) everything stays in memory.
+// The URLs of a segment which cannot be read back are lost, takeLost() tells how many so that
+// the caller can account for them.
+class SpillQueue {
+private:
+    struct Segment {
+        std::string file;
+        size_t count;
+    };
+
+    std::string prefix; // Path prefix of the segment files, empty to never spill
+    size_t window;
+    std::deque<FrontierEntry> head;  // Oldest URLs
+    std::deque<Segment> segments;    // Oldest first, all newer than head
+    std::deque<FrontierEntry> tail;  // Newest URLs, not written yet
+    size_t numFiles;
+    size_t count;
+    size_t lost; // URLs lost since the last takeLost()
+
+    size_t batchSize() const {
+        return std::max<size_t>(window / 2, 1);
+    }
+
+    void writeSegment() {
+        std::string file = prefix + std::to_string(numFiles++);
+        std::ofstream out(file, std::ios::binary | std::ios::trunc);
+        for (const FrontierEntry& entry : tail) {
+            uint32_t length = (uint32_t) entry.url.size();
+            out.write((const char*) &length, sizeof(length));
+            out.write((const char*) &entry.depth, sizeof(entry.depth));
+            out.write(entry.url.data(), length);
+        }
+        out.close();
+        if (!out) {
+            // Keep the batch in memory rather than losing it
+            std::cerr << "Failed to write frontier segment " << file << std::endl;
+            std::remove(file.c_str());
+            return;
+        }
+        segments.push_back(Segment{file, tail.size()});
+        tail.clear();
+    }
+
+    void readSegment() {
+        Segment segment = segments.front();
+        segments.pop_front();
+        std::ifstream in(segment.file, std::ios::binary | std::ios::ate);
+        std::streamoff left = in ? (std::streamoff) in.tellg() : 0;
+        in.seekg(0);
+        size_t read = 0;
+        uint32_t length;
+        while (read < segment.count && in.read((char*) &length, sizeof(length))) {
+            left -= sizeof(length) + sizeof(uint32_t);
+            if ((std::streamoff) length > left) break;
+            left -= length;
+            FrontierEntry entry{std::string(length, '\0'), 0};
+            if (!in.read((char*) &entry.depth, sizeof(entry.depth)) || !in.read(&entry.url[0], length)) break;
+            head.push_back(std::move(entry));
+            read++;
+        }
+        if (read < segment.count) {
+            std::cerr << "Lost " << segment.count - read << " URLs of frontier segment " << segment.file << std::endl;
+            count -= segment.count - read;
+            lost += segment.count - read;
+        }
+        in.close();
+        std::remove(segment.file.c_str());
+    }
+
+public:
+    SpillQueue() : window(0), numFiles(0), count(0), lost(0) {}
+    SpillQueue(const SpillQueue&) = delete;
+    SpillQueue& operator=(const SpillQueue&) = delete;
+
+    ~SpillQueue() {
+        for (const Segment& segment : segments) {
+            std::remove(segment.file.c_str());
+        }
+    }
+
+    // Spill to files named prefix followed by a number beyond window URLs in memory
+    void configure(const std::string& prefix, size_t window) {
+        this->prefix = prefix;
+        this->window = window;
+    }
+
+    void push_back(const FrontierEntry& entry) {
+        count++;
+        if (prefix.empty() || window == 0 || (segments.empty() && tail.empty() && head.size() < window)) {
+            head.push_back(entry);
+            return;
+        }
+        tail.push_back(entry);
+        if (tail.size() >= batchSize()) {
+            writeSegment();
+        }
+    }
+
+    // Take the oldest URL, false if none is left (the segments left may have been lost)
+    bool pop_front(FrontierEntry& entry) {
+        while (head.empty() && !segments.empty()) {
+            readSegment();
+        }
+        if (head.empty()) {
+            head.swap(tail);
+        }
+        if (head.empty()) {
+            lost += count;
+            count = 0;
+            return false;
+        }
+        entry = std::move(head.front());
+        head.pop_front();
+        count--;
+        return true;
+    }
+
+    bool empty() const {
+        return count == 0;
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+    // Number of URLs lost with their segment since the last call
+    size_t takeLost() {
+        size_t n = lost;
+        lost = 0;
+        return n;
+    }
+};
+
+// Score of a URL for a best first frontier, the lowest is fetched first
+typedef uint64_t (*FrontierScore)(const FrontierEntry& entry);
+
+// Breadth first: the fewest links from the seed first
+uint64_t scoreByDepth(const FrontierEntry& entry) {
+    return entry.depth;
+}
+
+// Shortest URLs first, pages close to the root of the site are usually its hubs
+uint64_t scoreByUrlLength(const FrontierEntry& entry) {
+    return entry.url.size();
+}
+
+// Score of the order named name (fifo, depth or url-length), false if unknown (nullptr for fifo)
+bool parseCrawlOrder(const std::string& name, FrontierScore& score) {
+    if (name == "fifo") {
+        score = nullptr;
+    } else if (name == "depth") {
+        score = scoreByDepth;
+    } else if (name == "url-length") {
+        score = scoreByUrlLength;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Best first frontier in memory: a binary heap of URLs by score, the oldest first among equal
+// scores, so that without a score it is a FIFO
+class PriorityFrontier {
+private:
+    struct Ranked {
+        uint64_t score;
+        uint64_t sequence;
+        FrontierEntry entry;
+
+        bool operator<(const Ranked& other) const {
+            // std::push_heap keeps the greatest on top
+            return score != other.score ? score > other.score : sequence > other.sequence;
+        }
+    };
+
+    FrontierScore score;
+    std::vector<Ranked> heap;
+    uint64_t pushed;
+
+public:
+    explicit PriorityFrontier(FrontierScore score = nullptr) : score(score), pushed(0) {}
+
+    void setScore(FrontierScore score) {
+        this->score = score;
+    }
+
+    void push_back(const FrontierEntry& entry) {
+        heap.push_back(Ranked{score ? score(entry) : 0, pushed++, entry});
+        std::push_heap(heap.begin(), heap.end());
+    }
+
+    // Take the URL of lowest score, the frontier must not be empty
+    FrontierEntry pop_front() {
+        std::pop_heap(heap.begin(), heap.end());
+        FrontierEntry entry = std::move(heap.back().entry);
+        heap.pop_back();
+        return entry;
+    }
+
+    bool empty() const {
+        return heap.empty();
+    }
+
+    size_t size() const {
+        return heap.size();
+    }
+};
+
+// Limits of a crawl, shared by its workers
+// URLs deeper than maxDepth are not crawled, and no page is fetched once maxPages have been or
+// the time limit has passed since the budget was made (a negative maxDepth, 0 maxPages or time
+// limit for no limit). Once exhausted it stays so, and the crawl lets the transfers in flight
+// finish and drops the rest of its frontier.
+class CrawlBudget {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+private:
+    long maxDepth;
+    size_t maxPages;
+    Clock::time_point deadline; // Clock::time_point::max() for none
+    std::atomic<size_t> taken;
+    std::atomic<bool> over;
+
+public:
+    CrawlBudget(long maxDepth, size_t maxPages, std::chrono::seconds timeLimit)
+        : maxDepth(maxDepth), maxPages(maxPages),
+          deadline(timeLimit.count() > 0 ? Clock::now() + timeLimit : Clock::time_point::max()),
+          taken(0), over(false) {}
+
+    bool allowsDepth(uint32_t depth) const {
+        return maxDepth < 0 || (long) depth <= maxDepth;
+    }
+
+    // Count a page about to be fetched, false if the budget is exhausted
+    bool takePage() {
+        if (over.load(std::memory_order_relaxed)) return false;
+        if ((maxPages > 0 && taken.fetch_add(1, std::memory_order_relaxed) >= maxPages) || Clock::now() >= deadline) {
+            over.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    bool exhausted() const {
+        return over.load(std::memory_order_relaxed);
+    }
+
+    Clock::time_point getDeadline() const {
+        return deadline;
+    }
+};
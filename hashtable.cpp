@@ -1,13 +1,27 @@
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <mutex>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 // Non parallel Set List
+// The URLs are kept in an arena, the list only holds their handles
 class SetList {
 private:
-    std::vector<std::string> urls;
+    UrlArena arena;
+    std::vector<uint32_t> urls;
     std::mutex lock;
     int size;
 
@@ -18,11 +32,25 @@ public:
     bool addURL(const std::string& url) {
         if (containsURL(url)) return false;
         std::lock_guard<std::mutex> guard(lock);
-        urls.push_back(url);
+        urls.push_back(arena.intern(url));
         size++;
         return true;
     }
 
+    // Add several URLs under one lock, tells which ones were new
+    std::vector<bool> addURLs(const std::vector<std::string_view>& batch) {
+        std::vector<bool> added(batch.size(), false);
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (std::none_of(urls.begin(), urls.end(), [&](uint32_t u) { return arena.equals(u, batch[i]); })) {
+                urls.push_back(arena.intern(batch[i]));
+                size++;
+                added[i] = true;
+            }
+        }
+        return added;
+    }
+
     int getSize(){
         std::lock_guard<std::mutex> guard(lock);
         return size;
@@ -31,76 +59,268 @@ public:
     // Display all URLs in the list
     void display() {
         std::lock_guard<std::mutex> guard(lock);
-        for (const auto& url : urls) {
-            std::cout << url << std::endl;
+        for (uint32_t url : urls) {
+            std::cout << arena.get(url) << '\n';
         }
+        std::cout.flush();
     }
 
     // Check if a URL is present in the list
     bool containsURL(const std::string& url) {
         std::lock_guard<std::mutex> guard(lock);
-        return std::find(urls.begin(), urls.end(), url) != urls.end();
+        for (uint32_t u : urls) {
+            if (arena.equals(u, url)) return true;
+        }
+        return false;
     }
 
     // Clear the list of URLs
     void clearList() {
         std::lock_guard<std::mutex> guard(lock);
         urls.clear();
+        arena.clear();
+        size = 0;
     }
 };
 
+// Hash functions of the hash tables: std::hash...
+template <typename T>
+struct TableHash {
+    size_t operator()(const T& x) const { return std::hash<T>{}(x); }
+};
+
+// ...except for URLs, their 64 bit fingerprint (FNV-1a and murmur3 finalizer, no allocation)
+template <>
+struct TableHash<std::string> {
+    size_t operator()(std::string_view x) const { return urlFingerprint(x); }
+};
+
+// How the hash tables keep their elements: as they are...
+template <typename T>
+struct TableStore {
+    typedef T Stored;
+
+    Stored store(const T& x) { return x; }
+    bool equals(const Stored& s, const T& x) const { return s == x; }
+    const T& load(const Stored& s) const { return s; }
+    void clear() {}
+};
+
+// ...except URLs, interned in an arena and kept as 32 bit handles
+template <>
+struct TableStore<std::string> {
+    typedef uint32_t Stored;
+    UrlArena arena;
+
+    Stored store(std::string_view x) { return arena.intern(x); }
+    bool equals(Stored s, std::string_view x) const { return arena.equals(s, x); }
+    std::string load(Stored s) const { return arena.get(s); }
+    void clear() { arena.clear(); }
+};
+
 // Simple Parallel Hash Table
 // https://dl.acm.org/doi/pdf/10.5555/2385452
-template <typename T>
+// Resizing is incremental: a resize only swaps in an empty table twice as big, and the buckets
+// of the old table are then moved a few at a time by the operations that hold their lock. The
+// stripes no operation came to migrate are moved by the next resize, before it swaps its table.
+// One thread resizes at a time, the others go on rather than each allocate a new table.
+// Buckets are grouped in stripes (bucket i belongs to stripe i % numStripes) and every lock
+// protects one stripe, in the old table as well as in the new one.
+// The locking and resize policy is the Derived class (policy, resize, lockStripe and unlockStripe),
+// called without any virtual dispatch. An element is hashed once per operation with Hash, and its
+// hash is kept next to it: lookups compare hashes before elements and migrations never rehash.
+template <typename T, class Derived, class Hash = TableHash<T>>
 class BaseHashTable {
 protected:
-    std::vector<std::vector<T>> table;
-    int setSize;
+    typedef typename TableStore<T>::Stored Stored;
+    struct Entry {
+        size_t hash;
+        Stored value;
+    };
+    typedef std::vector<std::vector<Entry>> Table;
 
-public:
-    BaseHashTable(int capacity) : table(capacity), setSize(0) {
-        for (int i = 0; i < capacity; i++){
-            table[i] = std::vector<T>();
+    static const size_t MIGRATE_BATCH = 4;
+
+    Hash hasher;
+    TableStore<T> store;
+    Table table;
+    // Buckets of the table before the last resize, emptied as they are migrated
+    Table oldTable;
+    // For each stripe, number of its buckets of oldTable already moved into table
+    std::vector<size_t> migrated;
+    // Number of stripes which still have buckets in oldTable
+    std::atomic<size_t> stripesLeft;
+    std::atomic<size_t> capacity;
+    std::atomic<int> setSize;
+    // A thread is resizing, the others go on instead of allocating a table of their own
+    std::atomic<bool> resizing;
+
+    Derived& self() {
+        return static_cast<Derived&>(*this);
+    }
+
+    // Move the next old buckets of the stripe (lock of the stripe held)
+    void migrateStripe(size_t stripe) {
+        size_t numStripes = migrated.size();
+        size_t oldPerStripe = oldTable.size() / numStripes;
+        size_t& done = migrated[stripe];
+        if (done == oldPerStripe) return;
+        for (size_t n = 0; n < MIGRATE_BATCH && done < oldPerStripe; n++, done++) {
+            std::vector<Entry>& bucket = oldTable[stripe + done * numStripes];
+            for (auto& e : bucket) {
+                table[e.hash % table.size()].push_back(std::move(e));
+            }
+            std::vector<Entry>().swap(bucket);
+        }
+        if (done == oldPerStripe) stripesLeft--;
+    }
+
+    size_t stripeOf(size_t hash) const {
+        return hash % migrated.size();
+    }
+
+    // Bucket where the element of the hash is or has to be inserted (lock of its stripe held)
+    std::vector<Entry>& bucketAt(size_t hash) {
+        size_t stripe = stripeOf(hash);
+        migrateStripe(stripe);
+        if (!oldTable.empty()) {
+            size_t oldIndex = hash % oldTable.size();
+            if (oldIndex / migrated.size() >= migrated[stripe]) {
+                return oldTable[oldIndex];
+            }
+        }
+        return table[hash % table.size()];
+    }
+
+    template <class K>
+    bool contains(const std::vector<Entry>& bucket, size_t hash, const K& x) const {
+        for (const Entry& e : bucket) {
+            if (e.hash == hash && store.equals(e.value, x)) return true;
         }
+        return false;
+    }
+
+    // Insert x of the given hash unless it is there (lock of its stripe held), true if it was not
+    template <class K>
+    bool insert(size_t hash, const K& x) {
+        std::vector<Entry>& bucket = bucketAt(hash);
+        if (contains(bucket, hash, x)) return false;
+        bucket.push_back(Entry{hash, store.store(x)});
+        setSize++;
+        return true;
+    }
+
+    // Claim the resize before allocating anything, false if another thread has it or already
+    // resized the table enough (endResize once done)
+    bool beginResize() {
+        bool expected = false;
+        if (!resizing.compare_exchange_strong(expected, true)) return false;
+        if (!self().policy()) {
+            resizing = false;
+            return false;
+        }
+        return true;
     }
 
+    void endResize() {
+        resizing = false;
+    }
+
+    // Swap in newTable as the table and start migrating into it (all locks held), after moving
+    // what is left of the previous migration
+    void startMigration(Table& newTable) {
+        for (size_t stripe = 0; stripesLeft > 0 && stripe < migrated.size(); stripe++) {
+            while (migrated[stripe] < oldTable.size() / migrated.size()) {
+                migrateStripe(stripe);
+            }
+        }
+        Table().swap(oldTable);
+        oldTable.swap(table);
+        table.swap(newTable);
+        std::fill(migrated.begin(), migrated.end(), 0);
+        stripesLeft = migrated.size();
+        capacity = table.size();
+    }
+
+public:
+    BaseHashTable(int capacity, int numStripes) : table(capacity), migrated(numStripes, 0),
+        stripesLeft(0), capacity(capacity), setSize(0), resizing(false) {}
+
     int getSize(){
         return setSize;
     }
 
     // Add a URL to the hash table
-    bool addURL(const T& url) {
-        bool result = false;
-        acquire(url);
-        int table_index = (int) std::hash<T>{}(url) % table.size();
-        std::vector<T>& bucket = table[table_index];
-        if (std::find(bucket.begin(), bucket.end(), url) == bucket.end()) {
-            bucket.push_back(url);
-            result = true;
-            setSize++;
-        }
-        release(url);
-
-        if (policy()) resize();
+    template <class K = T>
+    bool addURL(const K& url) {
+        size_t hash = hasher(url);
+        size_t stripe = stripeOf(hash);
+        self().lockStripe(stripe);
+        bool result = insert(hash, url);
+        self().unlockStripe(stripe);
+
+        if (self().policy()) self().resize();
         return result;
     }
 
+    // Add several URLs, tells which ones were new
+    // They are hashed once and grouped by stripe, so every lock is taken once for the whole batch
+    template <class K>
+    std::vector<bool> addURLs(const std::vector<K>& batch) {
+        std::vector<bool> added(batch.size(), false);
+        std::vector<std::pair<size_t, size_t>> order; // (hash, index) sorted by stripe
+        order.reserve(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            order.emplace_back(hasher(batch[i]), i);
+        }
+        std::sort(order.begin(), order.end(), [this](const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) {
+            return std::make_pair(stripeOf(a.first), a.second) < std::make_pair(stripeOf(b.first), b.second);
+        });
+        for (size_t begin = 0; begin < order.size(); ) {
+            size_t stripe = stripeOf(order[begin].first);
+            size_t end = begin;
+            self().lockStripe(stripe);
+            for (; end < order.size() && stripeOf(order[end].first) == stripe; end++) {
+                added[order[end].second] = insert(order[end].first, batch[order[end].second]);
+            }
+            self().unlockStripe(stripe);
+            begin = end;
+        }
+
+        if (self().policy()) self().resize();
+        return added;
+    }
+
     // Check if a URL is present in the hash table
-    bool containsURL(const T& url) {
-        acquire(url);
-        int table_index = std::hash<T>{}(url) % table.size();
-        std::vector<T>& bucket = table[table_index];
-        release(url);
-        return std::find(bucket.begin(), bucket.end(), url) != bucket.end();
+    template <class K = T>
+    bool containsURL(const K& url) {
+        size_t hash = hasher(url);
+        size_t stripe = stripeOf(hash);
+        self().lockStripe(stripe);
+        bool result = contains(bucketAt(hash), hash, url);
+        self().unlockStripe(stripe);
+        return result;
     }
 
-    // Display all URLs in the hash table
-    void display() const {
+    // Display all URLs in the hash table (all the stripes locked, in order like a resize)
+    void display() {
+        for (size_t stripe = 0; stripe < migrated.size(); stripe++) {
+            self().lockStripe(stripe);
+        }
+        for (const auto& bucket : oldTable) {
+            for (const Entry& e : bucket) {
+                std::cout << store.load(e.value) << '\n';
+            }
+        }
         for (const auto& bucket : table) {
-            for (const auto& url : bucket) {
-                std::cout << url << std::endl;
+            for (const Entry& e : bucket) {
+                std::cout << store.load(e.value) << '\n';
             }
         }
+        std::cout.flush();
+        for (size_t stripe = 0; stripe < migrated.size(); stripe++) {
+            self().unlockStripe(stripe);
+        }
     }
 
     // Clear the hash table of URLs
@@ -109,109 +329,523 @@ public:
         for (auto& bucket : table) {
             bucket.clear();
         }
+        oldTable.clear();
+        std::fill(migrated.begin(), migrated.end(), 0);
+        stripesLeft = 0;
+        store.clear();
     }
-
-    virtual bool policy() = 0;
-    virtual void resize() = 0;
-    virtual void acquire(const T& x) = 0;
-    virtual void release(const T& x) = 0;
-
 };
 
 // Coarse Grained Hash Set
-template <typename T>
-class CoarseHashTable : public BaseHashTable<T> {
+template <typename T, class Hash = TableHash<T>>
+class CoarseHashTable : public BaseHashTable<T, CoarseHashTable<T, Hash>, Hash> {
 private:
+    typedef BaseHashTable<T, CoarseHashTable<T, Hash>, Hash> Base;
     std::mutex lock;
 
 public:
-    CoarseHashTable(int capacity) : BaseHashTable<T>(capacity) {}
+    CoarseHashTable(int capacity) : Base(capacity, 1) {}
 
     // Checks if the hash table is too big and has to be resized
     bool policy() {
-        std::lock_guard<std::mutex> guard(lock);
-        return this->setSize / this->table.size() > 4;
+        return this->setSize / this->capacity > 4;
     }
 
     // Resize the hash table
     void resize(){
-        std::lock_guard<std::mutex> guard(lock);
-        int oldCapacity = this->table.size();
-        if (oldCapacity != this->table.size()) {
-            return;
-        }
-        int newCapacity = 2 * oldCapacity;
-        std::vector<std::vector<T>> oldTable = this->table;
-        this->table = std::vector<std::vector<T>>(newCapacity);
-        for (int i = 0; i < newCapacity; i++){
-            this->table[i] = std::vector<T>();
-        }
-        for (auto& bucket : oldTable){
-            for (auto& x : bucket){
-                int newBucket = std::hash<T>{}(x) % newCapacity;
-                this->table[newBucket].push_back(x);
-            }
+        if (!this->beginResize()) return;
+        typename Base::Table newTable(2 * this->capacity);
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            this->startMigration(newTable);
         }
+        this->endResize();
     }
 
-    void acquire(const T& x) {
-        lock.lock();
+    void lockStripe(size_t stripe) {
+        lockTimed(lock, SET_LOCK_WAIT_NS);
     }
 
-    void release(const T& x) {
+    void unlockStripe(size_t stripe) {
         lock.unlock();
     }
 };
 
 // Striped Hash Table
-template <typename T>
-class StripedHashTable : public BaseHashTable<T> {
+template <typename T, class Hash = TableHash<T>>
+class StripedHashTable : public BaseHashTable<T, StripedHashTable<T, Hash>, Hash> {
 private:
+    typedef BaseHashTable<T, StripedHashTable<T, Hash>, Hash> Base;
     std::vector<std::mutex> locks;
 
 public:
-    StripedHashTable(int capacity) : BaseHashTable<T>(capacity), locks(capacity) {}
+    StripedHashTable(int capacity) : Base(capacity, capacity), locks(capacity) {}
 
     // Checks if the hash table is too big and has to be resized
     bool policy() {
+        return this->setSize / this->capacity > 4;
+    }
+
+    // Resize the hash table
+    void resize() {
+        if (!this->beginResize()) return;
+        typename Base::Table newTable(2 * this->capacity);
         for (auto& lock : locks){
             lock.lock();
         }
-        bool answer = this->setSize / this->table.size() > 4;
+        this->startMigration(newTable);
         for (auto& lock : locks){
             lock.unlock();
         }
-        return answer;
+        this->endResize();
     }
 
-    // Resize the hash table
-    void resize() {
-        for (auto& lock : locks){
-            lock.lock();
+    void lockStripe(size_t stripe) {
+        lockTimed(locks[stripe], SET_LOCK_WAIT_NS);
+    }
+
+    void unlockStripe(size_t stripe) {
+        locks[stripe].unlock();
+    }
+};
+
+
+// Lock-free Open Addressing Hash Set
+// URLs are keyed by their 64 bit fingerprint, inserted with a CAS on an empty slot (linear probing)
+// and looked up without any lock. The URLs themselves are interned in an arena. The table is split in segments chosen by the top bits of the
+// fingerprint: a segment that gets too full is doubled by one thread while inserters of that segment
+// only (never readers) wait. Old slot arrays are kept until destruction so readers can still use them.
+class LockFreeHashTable {
+private:
+    static const int SEGMENT_BITS = 6;
+    static const int NUM_SEGMENTS = 1 << SEGMENT_BITS;
+    static const uint32_t RESIZING = 1u << 31;
+
+    struct Slots {
+        size_t capacity;
+        std::unique_ptr<std::atomic<uint64_t>[]> keys;
+        std::unique_ptr<std::atomic<uint32_t>[]> urls; // Arena handles, 0 until set
+
+        Slots(size_t capacity) : capacity(capacity),
+            keys(new std::atomic<uint64_t>[capacity]), urls(new std::atomic<uint32_t>[capacity]) {
+            for (size_t i = 0; i < capacity; i++) {
+                keys[i].store(0, std::memory_order_relaxed);
+                urls[i].store(0, std::memory_order_relaxed);
+            }
         }
-        int oldCapacity = this->table.size();
-        int newCapacity = 2 * oldCapacity;
-        std::vector<std::vector<T>> oldTable = this->table;
-        this->table = std::vector<std::vector<T>>(newCapacity);
-        for (int i = 0; i < newCapacity; i++) {
-            this->table[i] = std::vector<T>();
+    };
+
+    struct Segment {
+        std::atomic<Slots*> slots;
+        std::atomic<size_t> count;
+        std::atomic<uint32_t> gate; // number of inserters inside the segment | RESIZING
+        std::mutex resizeLock;
+        std::vector<std::unique_ptr<Slots>> retired;
+
+        Segment() : slots(nullptr), count(0), gate(0) {}
+    };
+
+    enum InsertResult { INSERTED, PRESENT, FULL };
+
+    Segment segments[NUM_SEGMENTS];
+    UrlArena arena;
+
+    Segment& segmentFor(uint64_t fp) {
+        return segments[fp >> (64 - SEGMENT_BITS)];
+    }
+
+    // Probe for fp and claim the first empty slot with a CAS
+    InsertResult insertInto(Slots* t, uint64_t fp, std::string_view url) {
+        size_t mask = t->capacity - 1;
+        size_t i = fp & mask;
+        for (size_t probes = 0; probes < t->capacity; probes++, i = (i + 1) & mask) {
+            uint64_t current = t->keys[i].load(std::memory_order_acquire);
+            if (current == 0) {
+                if (t->keys[i].compare_exchange_strong(current, fp, std::memory_order_acq_rel)) {
+                    t->urls[i].store(arena.intern(url), std::memory_order_release);
+                    return INSERTED;
+                }
+                // Lost the race for this slot, current now holds the winner
+            }
+            if (current == fp) {
+                return PRESENT;
+            }
         }
-        for (auto& bucket : oldTable){
-            for (auto& x : bucket){
-                int newBucket = std::hash<T>{}(x) % newCapacity;
-                this->table[newBucket].push_back(x);
+        return FULL;
+    }
+
+    static bool lookup(Slots* t, uint64_t fp) {
+        size_t mask = t->capacity - 1;
+        size_t i = fp & mask;
+        for (size_t probes = 0; probes < t->capacity; probes++, i = (i + 1) & mask) {
+            uint64_t current = t->keys[i].load(std::memory_order_acquire);
+            if (current == fp) return true;
+            if (current == 0) return false;
+        }
+        return false;
+    }
+
+    // Enter the segment as an inserter, waiting while it is being resized
+    static void enter(Segment& s) {
+        uint32_t g = s.gate.load(std::memory_order_acquire);
+        while (true) {
+            if (g & RESIZING) {
+                std::this_thread::yield();
+                g = s.gate.load(std::memory_order_acquire);
+            } else if (s.gate.compare_exchange_weak(g, g + 1, std::memory_order_acq_rel)) {
+                return;
             }
         }
-        for (auto& lock : locks){
-            lock.unlock();
+    }
+
+    static void leave(Segment& s) {
+        s.gate.fetch_sub(1, std::memory_order_release);
+    }
+
+    // Double the slots of a segment, unless another thread already replaced `seen`
+    static void grow(Segment& s, Slots* seen) {
+        std::lock_guard<std::mutex> guard(s.resizeLock);
+        Slots* old = s.slots.load(std::memory_order_acquire);
+        if (old != seen) {
+            return;
+        }
+        s.gate.fetch_or(RESIZING, std::memory_order_acq_rel);
+        while ((s.gate.load(std::memory_order_acquire) & ~RESIZING) != 0) {
+            std::this_thread::yield();
+        }
+        Slots* bigger = new Slots(2 * old->capacity);
+        size_t mask = bigger->capacity - 1;
+        for (size_t i = 0; i < old->capacity; i++) {
+            uint64_t fp = old->keys[i].load(std::memory_order_relaxed);
+            if (fp == 0) continue;
+            size_t j = fp & mask;
+            while (bigger->keys[j].load(std::memory_order_relaxed) != 0) {
+                j = (j + 1) & mask;
+            }
+            bigger->keys[j].store(fp, std::memory_order_relaxed);
+            bigger->urls[j].store(old->urls[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        }
+        s.slots.store(bigger, std::memory_order_release);
+        s.retired.emplace_back(old);
+        s.gate.fetch_and(~RESIZING, std::memory_order_release);
+    }
+
+public:
+    LockFreeHashTable(int capacity) {
+        size_t perSegment = 16;
+        while (perSegment * NUM_SEGMENTS < (size_t) capacity) {
+            perSegment *= 2;
+        }
+        for (auto& s : segments) {
+            s.slots.store(new Slots(perSegment), std::memory_order_relaxed);
+        }
+    }
+
+    ~LockFreeHashTable() {
+        clearList();
+        for (auto& s : segments) {
+            delete s.slots.load(std::memory_order_relaxed);
+        }
+    }
+
+    int getSize() {
+        size_t total = 0;
+        for (auto& s : segments) {
+            total += s.count.load(std::memory_order_relaxed);
+        }
+        return (int) total;
+    }
+
+    // Add a URL to the hash table
+    bool addURL(std::string_view url) {
+        uint64_t fp = urlFingerprint(url);
+        Segment& s = segmentFor(fp);
+        while (true) {
+            enter(s);
+            Slots* t = s.slots.load(std::memory_order_acquire);
+            InsertResult result = insertInto(t, fp, url);
+            leave(s);
+            if (result == FULL) {
+                grow(s, t);
+                continue;
+            }
+            if (result == INSERTED) {
+                // Keep the load factor under 3/4 so probe sequences stay short
+                if (s.count.fetch_add(1, std::memory_order_relaxed) + 1 > t->capacity / 4 * 3) {
+                    grow(s, t);
+                }
+                return true;
+            }
+            return false;
+        }
+    }
+
+    // Add several URLs, tells which ones were new (nothing to batch without locks)
+    std::vector<bool> addURLs(const std::vector<std::string_view>& batch) {
+        std::vector<bool> added(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            added[i] = addURL(batch[i]);
         }
+        return added;
     }
 
-    void acquire(const T& x) {
-        locks[std::hash<T>{}(x) % locks.size()].lock();
+    // Check if a URL is present in the hash table
+    bool containsURL(const std::string& url) {
+        uint64_t fp = urlFingerprint(url);
+        return lookup(segmentFor(fp).slots.load(std::memory_order_acquire), fp);
+    }
+
+    // Display all URLs in the hash table
+    void display() const {
+        for (const auto& s : segments) {
+            Slots* t = s.slots.load(std::memory_order_acquire);
+            for (size_t i = 0; i < t->capacity; i++) {
+                uint32_t url = t->urls[i].load(std::memory_order_acquire);
+                if (url) {
+                    std::cout << arena.get(url) << '\n';
+                }
+            }
+        }
+        std::cout.flush();
     }
 
-    void release(const T& x) {
-        locks[std::hash<T>{}(x) % locks.size()].unlock();
+    // Clear the hash table of URLs (not safe against concurrent inserts)
+    void clearList() {
+        for (auto& s : segments) {
+            Slots* t = s.slots.load(std::memory_order_relaxed);
+            for (size_t i = 0; i < t->capacity; i++) {
+                t->urls[i].store(0, std::memory_order_relaxed);
+                t->keys[i].store(0, std::memory_order_relaxed);
+            }
+            s.retired.clear();
+            s.count.store(0, std::memory_order_relaxed);
+        }
+        arena.clear();
     }
-};
\ No newline at end of file
+};
+
+// Memory-mapped Fingerprint Set
+// Visited set for crawls larger than memory: only the 64 bit fingerprints of the URLs are kept, in
+// an open addressing table (linear probing) mapped from a file, so under memory pressure the kernel
+// writes its pages back and evicts them instead of the process running out of memory. The URLs
+// themselves are appended to a log file next to it, which display() reads back. URLs with the same
+// fingerprint (about one pair in 10^19) count as one. Not thread safe: the crawler serializes it with
+// its set mutex. Both files are removed on destruction.
+// The table holds capacity / 2 URLs before doubling, a rehash into a new file while the set is
+// locked, so it should be sized for the URLs expected. With a resident limit (limitResident), once
+// the URLs added or looked up could have brought that many bytes of the table into memory, its pages
+// are released to the file (MADV_DONTNEED), which keeps the resident memory of the set under the
+// limit whatever the size of the table.
+class MappedFingerprintSet {
+private:
+    std::string path;
+    int fd;
+    uint64_t* slots;
+    size_t capacity; // Power of 2
+    int size;
+    std::ofstream log;
+    bool logFailed;
+    size_t refused;       // New URLs refused as the table was full
+    size_t residentLimit; // Bytes, 0 for no limit
+    size_t touched;       // Pages brought into memory at most since the last release
+
+    // Map a zeroed table of capacity slots from a new file, nullptr on failure
+    static uint64_t* mapTable(const std::string& file, size_t capacity, int& fd) {
+        fd = open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600);
+        if (fd < 0) return nullptr;
+        size_t bytes = capacity * sizeof(uint64_t);
+        void* p = MAP_FAILED;
+        if (ftruncate(fd, bytes) == 0) {
+            p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        }
+        if (p == MAP_FAILED) {
+            close(fd);
+            fd = -1;
+            return nullptr;
+        }
+        madvise(p, bytes, MADV_RANDOM); // Probes are random, read ahead would only waste memory
+        return (uint64_t*) p;
+    }
+
+    static void unmapTable(uint64_t* slots, size_t capacity, int fd) {
+        if (slots) munmap(slots, capacity * sizeof(uint64_t));
+        if (fd >= 0) close(fd);
+    }
+
+    static bool insertInto(uint64_t* slots, size_t capacity, uint64_t fp) {
+        size_t mask = capacity - 1;
+        for (size_t i = fp & mask; ; i = (i + 1) & mask) {
+            if (slots[i] == fp) return false;
+            if (slots[i] == 0) {
+                slots[i] = fp;
+                return true;
+            }
+        }
+    }
+
+    // Double the table into a new file which then replaces the old one
+    bool grow() {
+        std::string next = path + ".grow";
+        int nextFd;
+        uint64_t* bigger = mapTable(next, 2 * capacity, nextFd);
+        if (!bigger) {
+            std::cerr << "Failed to grow the fingerprint table " << path << std::endl;
+            return false;
+        }
+        for (size_t i = 0; i < capacity; i++) {
+            if (slots[i] != 0) insertInto(bigger, 2 * capacity, slots[i]);
+        }
+        unmapTable(slots, capacity, fd);
+        std::rename(next.c_str(), path.c_str());
+        slots = bigger;
+        fd = nextFd;
+        capacity *= 2;
+        touched = capacity * sizeof(uint64_t) / pageSize(); // The rehash went through all of it
+        return true;
+    }
+
+    static size_t pageSize() {
+        static const size_t bytes = (size_t) sysconf(_SC_PAGESIZE);
+        return bytes;
+    }
+
+    // An access to the table brought a few more pages into memory, release them all past the limit
+    // A read maps up to 16 pages around the one it needs (the default fault around of Linux)
+    void touch() {
+        if (residentLimit == 0 || capacity * sizeof(uint64_t) <= residentLimit) return;
+        touched += 16;
+        if (touched * pageSize() < residentLimit) return;
+        madvise(slots, capacity * sizeof(uint64_t), MADV_DONTNEED); // Shared mapping, the file keeps the data
+        touched = 0;
+    }
+
+public:
+    MappedFingerprintSet(const std::string& path, int capacity)
+        : path(path), fd(-1), slots(nullptr), capacity(1024), size(0), logFailed(false), refused(0), residentLimit(0), touched(0) {
+        while (this->capacity < 2 * (size_t) capacity) {
+            this->capacity *= 2;
+        }
+        slots = mapTable(path, this->capacity, fd);
+        if (!slots) {
+            std::cerr << "Failed to map the fingerprint table " << path << std::endl;
+        }
+        log.open(path + ".urls", std::ios::binary | std::ios::trunc);
+        if (!log.is_open()) {
+            std::cerr << "Failed to open the URL log " << path << ".urls" << std::endl;
+        }
+    }
+
+    ~MappedFingerprintSet() {
+        if (refused > 0) {
+            std::cerr << refused << " new URLs were refused as the fingerprint table " << path << " was full" << std::endl;
+        }
+        unmapTable(slots, capacity, fd);
+        log.close();
+        std::remove(path.c_str());
+        std::remove((path + ".urls").c_str());
+    }
+
+    // False if the files of the set could not be created
+    bool isOpen() const {
+        return slots && log.is_open();
+    }
+
+    int getSize() {
+        return size;
+    }
+
+    // Keep at most about bytes of the table in memory, 0 for no limit
+    void limitResident(size_t bytes) {
+        residentLimit = bytes;
+    }
+
+    // Add a URL to the set
+    bool addURL(std::string_view url) {
+        if (!slots) return false;
+        // Keep the load factor under 1/2, refuse URLs only once a failed growth left the table full
+        if (2 * ((size_t) size + 1) > capacity && !grow() && (size_t) size + 1 >= capacity) {
+            if (!containsURL(std::string(url))) {
+                if (refused++ == 0) {
+                    std::cerr << "The fingerprint table " << path << " is full, refusing the new URLs from " << url << std::endl;
+                }
+            }
+            return false;
+        }
+        bool added = insertInto(slots, capacity, urlFingerprint(url));
+        touch();
+        if (!added) {
+            return false;
+        }
+        size++;
+        log << url << '\n';
+        if (!log && !logFailed) {
+            std::cerr << "Failed to write the URL log " << path << ".urls, the URLs found will be missing from it" << std::endl;
+            logFailed = true;
+        }
+        return true;
+    }
+
+    // Add several URLs, tells which ones were new
+    std::vector<bool> addURLs(const std::vector<std::string_view>& batch) {
+        std::vector<bool> added(batch.size());
+        for (size_t i = 0; i < batch.size(); i++) {
+            added[i] = addURL(batch[i]);
+        }
+        return added;
+    }
+
+    // Check if a URL is present in the set
+    bool containsURL(const std::string& url) {
+        if (!slots) return false;
+        uint64_t fp = urlFingerprint(url);
+        size_t mask = capacity - 1;
+        size_t i = fp & mask;
+        while (slots[i] != fp && slots[i] != 0) {
+            i = (i + 1) & mask;
+        }
+        bool found = slots[i] == fp;
+        touch();
+        return found;
+    }
+
+    // Display all URLs of the set, in the order they were added
+    void display() {
+        log.flush();
+        std::ifstream in(path + ".urls", std::ios::binary);
+        std::string url;
+        while (std::getline(in, url)) {
+            std::cout << url << '\n';
+        }
+        std::cout.flush();
+    }
+
+    // Clear the set of URLs
+    void clearList() {
+        if (slots) {
+            memset(slots, 0, capacity * sizeof(uint64_t));
+            touched = capacity * sizeof(uint64_t) / pageSize();
+            touch();
+        }
+        size = 0;
+        log.close();
+        log.open(path + ".urls", std::ios::binary | std::ios::trunc);
+    }
+};
+
+// Sets that are looked up without any lock
+template <typename S>
+struct is_lock_free_set : std::false_type {};
+
+template <>
+struct is_lock_free_set<LockFreeHashTable> : std::true_type {};
+
+// Sets that are safe to share between threads without the crawler's outer set mutex: the lock-free
+// one, and the hash tables which lock their stripes themselves (so that a batch takes each once)
+template <typename S>
+struct is_concurrent_set : is_lock_free_set<S> {};
+
+template <typename T, class Hash>
+struct is_concurrent_set<CoarseHashTable<T, Hash>> : std::true_type {};
+
+template <typename T, class Hash>
+struct is_concurrent_set<StripedHashTable<T, Hash>> : std::true_type {};
@@ -0,0 +1,274 @@
+#include <string>
+#include <vector>
+#include <unordered_set>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <cmath>
+#include <cstdio>
+#include <cstdint>
+
+// Link graph of the crawl, to rank its pages (needs urlarena.cpp and threadpool.cpp)
+// Workers record the links of the pages they parse in a buffer of their own, the edges as pairs
+// of URL fingerprints plus the URLs the thread has not named yet, so recording takes no lock.
+// Once the crawl is over, build() turns them into a compressed sparse row graph over dense IDs,
+// the URLs sorted (so that the pages of a directory, which link to each other, get close IDs),
+// without the duplicate links nor the links of a page to itself.
+// File (write): "CSRG", version (uint32), number of pages and of links (uint64), the URLs in the
+// order of their IDs front coded (varint length of the prefix shared with the previous URL, varint
+// length of the rest, the rest), then for every page its number of links (varint) and the IDs it
+// links to in increasing order, the first as is and the others as the gap from the previous one
+// (varints of 7 bits per byte, least significant first).
+class LinkGraph {
+private:
+    struct Buffer {
+        std::vector<uint64_t> edges; // Source and target fingerprints, in pairs
+        std::unordered_set<uint64_t> named;
+        std::vector<std::pair<uint64_t, std::string>> names;
+    };
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<Buffer>> buffers;
+    std::vector<std::string> urls;  // By ID
+    std::vector<uint64_t> offsets;  // The links of page i are targets[offsets[i]] to targets[offsets[i + 1] - 1]
+    std::vector<uint32_t> targets;
+
+    Buffer& local() {
+        static thread_local LinkGraph* owner = nullptr;
+        static thread_local Buffer* buffer = nullptr;
+        if (owner != this) {
+            std::lock_guard<std::mutex> guard(lock);
+            buffers.emplace_back(new Buffer());
+            buffer = buffers.back().get();
+            owner = this;
+        }
+        return *buffer;
+    }
+
+    static uint64_t name(Buffer& buffer, const std::string& url) {
+        uint64_t fp = urlFingerprint(url);
+        if (buffer.named.insert(fp).second) buffer.names.emplace_back(fp, url);
+        return fp;
+    }
+
+    static void putVarint(std::ostream& out, uint64_t value) {
+        char bytes[10];
+        int n = 0;
+        do {
+            bytes[n++] = (char) ((value & 0x7f) | (value >= 0x80 ? 0x80 : 0));
+            value >>= 7;
+        } while (value > 0);
+        out.write(bytes, n);
+    }
+
+    // Run body(begin, end) over [0, n) in chunks on the pool, and wait for them
+    template <class F>
+    static void parallelFor(ThreadPool& pool, size_t chunks, size_t n, const F& body) {
+        for (size_t c = 0; c < chunks; c++) {
+            size_t begin = n * c / chunks, end = n * (c + 1) / chunks;
+            pool.add_task_to_queue([&body, c, begin, end]() { body(c, begin, end); });
+        }
+        pool.wait_idle();
+    }
+
+public:
+    // The page at url is parsed, returns its fingerprint for addLink
+    uint64_t addPage(const std::string& url) {
+        return name(local(), url);
+    }
+
+    // The page of fingerprint source links to url
+    void addLink(uint64_t source, const std::string& url) {
+        Buffer& buffer = local();
+        uint64_t target = name(buffer, url);
+        buffer.edges.push_back(source);
+        buffer.edges.push_back(target);
+    }
+
+    // Build the graph from what has been recorded, once no thread records anymore
+    void build() {
+        std::vector<std::pair<uint64_t, std::string>> nodes;
+        for (const auto& buffer : buffers) {
+            for (auto& named : buffer->names) {
+                nodes.push_back(std::move(named));
+            }
+            buffer->names = std::vector<std::pair<uint64_t, std::string>>();
+            buffer->named = std::unordered_set<uint64_t>();
+        }
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) {
+            return a.first == b.first;
+        }), nodes.end());
+        std::sort(nodes.begin(), nodes.end(), [](const auto& a, const auto& b) { return a.second < b.second; });
+
+        // Fingerprint -> ID, looked up by binary search
+        std::vector<std::pair<uint64_t, uint32_t>> ids(nodes.size());
+        urls.resize(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            ids[i] = std::make_pair(nodes[i].first, (uint32_t) i);
+            urls[i] = std::move(nodes[i].second);
+        }
+        nodes = std::vector<std::pair<uint64_t, std::string>>();
+        std::sort(ids.begin(), ids.end());
+        auto idOf = [&ids](uint64_t fp) {
+            return std::lower_bound(ids.begin(), ids.end(), std::make_pair(fp, (uint32_t) 0))->second;
+        };
+
+        std::vector<uint64_t> edges; // Source ID in the high half, target ID in the low one
+        for (const auto& buffer : buffers) {
+            for (size_t i = 0; i < buffer->edges.size(); i += 2) {
+                uint64_t source = idOf(buffer->edges[i]), target = idOf(buffer->edges[i + 1]);
+                if (source != target) edges.push_back(source << 32 | target);
+            }
+            buffer->edges = std::vector<uint64_t>();
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        offsets.assign(urls.size() + 1, 0);
+        targets.resize(edges.size());
+        for (size_t i = 0; i < edges.size(); i++) {
+            offsets[(edges[i] >> 32) + 1]++;
+            targets[i] = (uint32_t) edges[i];
+        }
+        for (size_t i = 0; i < urls.size(); i++) {
+            offsets[i + 1] += offsets[i];
+        }
+    }
+
+    size_t numPages() const {
+        return urls.size();
+    }
+
+    size_t numLinks() const {
+        return targets.size();
+    }
+
+    // Write the graph built to path, false on failure
+    bool write(const std::string& path) const {
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        uint32_t version = 1;
+        uint64_t counts[2] = {urls.size(), targets.size()};
+        out.write("CSRG", 4);
+        out.write((const char*) &version, sizeof(version));
+        out.write((const char*) counts, sizeof(counts));
+        for (size_t i = 0; i < urls.size(); i++) {
+            size_t shared = 0;
+            if (i > 0) {
+                size_t limit = std::min(urls[i].size(), urls[i - 1].size());
+                while (shared < limit && urls[i][shared] == urls[i - 1][shared]) shared++;
+            }
+            putVarint(out, shared);
+            putVarint(out, urls[i].size() - shared);
+            out.write(urls[i].data() + shared, urls[i].size() - shared);
+        }
+        for (size_t i = 0; i < urls.size(); i++) {
+            putVarint(out, offsets[i + 1] - offsets[i]);
+            uint32_t previous = 0;
+            for (uint64_t k = offsets[i]; k < offsets[i + 1]; k++) {
+                putVarint(out, targets[k] - previous);
+                previous = targets[k];
+            }
+        }
+        out.close();
+        if (!out) {
+            std::cerr << "Failed to write the link graph " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // PageRank of the pages of the graph built, and their number of inlinks, computed by numThreads tasks on the pool
+    // The rank is pulled along the inlinks of each page, from the transposed graph, so that every
+    // task only writes the ranks of its own pages. The rank of the pages without links is spread
+    // over all of them. Stops after maxIterations or once the ranks move by less than tolerance in total.
+    // Returns the number of iterations.
+    int pageRank(ThreadPool& pool, size_t numThreads, std::vector<double>& ranks, std::vector<uint32_t>& inlinks,
+                 double damping = 0.85, int maxIterations = 100, double tolerance = 1e-6) const {
+        size_t n = urls.size();
+        ranks.assign(n, n > 0 ? 1.0 / n : 0);
+        inlinks.assign(n, 0);
+        if (n == 0) return 0;
+
+        // Transpose: the sources of the links to page i are sources[inOffsets[i]] to sources[inOffsets[i + 1] - 1]
+        for (uint32_t target : targets) {
+            inlinks[target]++;
+        }
+        std::vector<uint64_t> inOffsets(n + 1, 0);
+        for (size_t i = 0; i < n; i++) {
+            inOffsets[i + 1] = inOffsets[i] + inlinks[i];
+        }
+        std::vector<uint32_t> sources(targets.size());
+        std::vector<uint64_t> next(inOffsets.begin(), inOffsets.end() - 1);
+        for (size_t i = 0; i < n; i++) {
+            for (uint64_t k = offsets[i]; k < offsets[i + 1]; k++) {
+                sources[next[targets[k]]++] = (uint32_t) i;
+            }
+        }
+
+        size_t chunks = std::min(std::max<size_t>(numThreads, 1) * 4, n);
+        std::vector<double> contributions(n);
+        std::vector<double> dangling(chunks), changes(chunks);
+        int iteration = 0;
+        while (iteration < maxIterations) {
+            iteration++;
+            parallelFor(pool, chunks, n, [&](size_t c, size_t begin, size_t end) {
+                double sum = 0;
+                for (size_t i = begin; i < end; i++) {
+                    uint64_t degree = offsets[i + 1] - offsets[i];
+                    contributions[i] = degree > 0 ? ranks[i] / degree : 0;
+                    if (degree == 0) sum += ranks[i];
+                }
+                dangling[c] = sum;
+            });
+            double base = (1 - damping) / n;
+            for (double d : dangling) {
+                base += damping * d / n;
+            }
+            parallelFor(pool, chunks, n, [&](size_t c, size_t begin, size_t end) {
+                double change = 0;
+                for (size_t i = begin; i < end; i++) {
+                    double sum = 0;
+                    for (uint64_t k = inOffsets[i]; k < inOffsets[i + 1]; k++) {
+                        sum += contributions[sources[k]];
+                    }
+                    double rank = base + damping * sum;
+                    change += std::fabs(rank - ranks[i]);
+                    ranks[i] = rank;
+                }
+                changes[c] = change;
+            });
+            double change = 0;
+            for (double d : changes) {
+                change += d;
+            }
+            if (change < tolerance) break;
+        }
+        return iteration;
+    }
+
+    // Write the pages by decreasing rank, one per line: URL, inlinks and rank separated by tabs, false on failure
+    bool writeRanks(const std::string& path, const std::vector<double>& ranks, const std::vector<uint32_t>& inlinks) const {
+        std::vector<uint32_t> order(urls.size());
+        for (size_t i = 0; i < order.size(); i++) {
+            order[i] = (uint32_t) i;
+        }
+        std::sort(order.begin(), order.end(), [&ranks](uint32_t a, uint32_t b) {
+            return ranks[a] != ranks[b] ? ranks[a] > ranks[b] : a < b;
+        });
+        std::ofstream out(path, std::ios::trunc);
+        char line[64];
+        for (uint32_t i : order) {
+            snprintf(line, sizeof(line), "\t%u\t%.9g\n", inlinks[i], ranks[i]);
+            out << urls[i] << line;
+        }
+        out.close();
+        if (!out) {
+            std::cerr << "Failed to write the page ranks " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
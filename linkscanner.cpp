@@ -0,0 +1,217 @@
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <algorithm>
+
+// HTML link scanner
+// Small state machine replacing the href regex: it jumps from one '<' to the next with memchr
+// (vectorized in glibc), parses the attributes of the tags only, skips comments and the content
+// of <script>/<style>, and hands the links to a callback as string_views into the page, without
+// copying them. Values can be quoted or not. The first <base href> is not returned as a link but
+// kept in baseHref(). With withSources, src and srcset attributes are returned too.
+// A page can also be fed chunk by chunk as it is downloaded: a tag cut by the end of a chunk
+// is kept and completed with the next one.
+class LinkScanner {
+private:
+    // Longest tag kept across chunks, longer ones are skipped
+    static const size_t MAX_CARRY = 64 * 1024;
+
+    bool withSources;
+    std::string base;
+    // "</script" or "</style" while inside the raw text of these tags, empty otherwise
+    std::string_view rawText;
+    // Unfinished tag (or end of raw text) at the end of the last chunk
+    std::string carry;
+
+    static bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f';
+    }
+
+    static bool isAlpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static bool equalsLower(std::string_view s, std::string_view lower) {
+        if (s.size() != lower.size()) return false;
+        for (size_t i = 0; i < s.size(); i++) {
+            char c = s[i];
+            if (c >= 'A' && c <= 'Z') c += 'a' - 'A';
+            if (c != lower[i]) return false;
+        }
+        return true;
+    }
+
+    static std::string_view trim(std::string_view s) {
+        while (!s.empty() && isSpace(s.front())) s.remove_prefix(1);
+        while (!s.empty() && isSpace(s.back())) s.remove_suffix(1);
+        return s;
+    }
+
+    // Position of the first occurrence of needle (case insensitive), or nullptr
+    static const char* findLower(const char* p, const char* end, std::string_view needle) {
+        while (p + needle.size() <= end) {
+            p = (const char*) memchr(p, needle[0], end - p - needle.size() + 1);
+            if (!p) return nullptr;
+            if (equalsLower(std::string_view(p, needle.size()), needle)) return p;
+            p++;
+        }
+        return nullptr;
+    }
+
+    // Each URL of a srcset ("a.png 1x, b.png 2x")
+    template <class F>
+    static void splitSrcset(std::string_view value, F& onLink) {
+        while (!value.empty()) {
+            size_t comma = value.find(',');
+            std::string_view candidate = trim(value.substr(0, comma));
+            size_t space = 0;
+            while (space < candidate.size() && !isSpace(candidate[space])) space++;
+            if (space > 0) onLink(candidate.substr(0, space));
+            if (comma == std::string_view::npos) break;
+            value.remove_prefix(comma + 1);
+        }
+    }
+
+    // Parse the tag starting at p (on '<'), returns the position after it
+    // or nullptr if the tag is not complete before end
+    template <class F>
+    const char* scanTag(const char* p, const char* end, F& onLink) {
+        const char* q = p + 1;
+        if (q >= end) return nullptr;
+        if (*q == '!') { // Comment or doctype
+            if (end - q >= 3 && q[1] == '-' && q[2] == '-') {
+                const char* close = findLower(q + 3, end, "-->");
+                return close ? close + 3 : nullptr;
+            }
+            const char* close = (const char*) memchr(q, '>', end - q);
+            return close ? close + 1 : nullptr;
+        }
+        if (*q == '/' || *q == '?') { // Closing tag or processing instruction
+            const char* close = (const char*) memchr(q, '>', end - q);
+            return close ? close + 1 : nullptr;
+        }
+        if (!isAlpha(*q)) return q; // A '<' in the text
+
+        const char* nameStart = q;
+        while (q < end && !isSpace(*q) && *q != '>' && *q != '/') q++;
+        if (q >= end) return nullptr;
+        std::string_view tag(nameStart, q - nameStart);
+        bool isBase = equalsLower(tag, "base");
+
+        // Attributes, only reported once the whole tag is known to be complete
+        std::string_view links[8];
+        std::string_view kinds[8];
+        int numLinks = 0;
+        while (true) {
+            while (q < end && (isSpace(*q) || *q == '/')) q++;
+            if (q >= end) return nullptr;
+            if (*q == '>') {
+                q++;
+                break;
+            }
+            const char* attrStart = q;
+            while (q < end && !isSpace(*q) && *q != '=' && *q != '>' && *q != '/') q++;
+            std::string_view attr(attrStart, q - attrStart);
+            while (q < end && isSpace(*q)) q++;
+            if (q >= end) return nullptr;
+            if (*q != '=') continue; // Attribute without value
+            q++;
+            while (q < end && isSpace(*q)) q++;
+            if (q >= end) return nullptr;
+            std::string_view value;
+            if (*q == '"' || *q == '\'') {
+                const char* close = (const char*) memchr(q + 1, *q, end - q - 1);
+                if (!close) return nullptr;
+                value = std::string_view(q + 1, close - q - 1);
+                q = close + 1;
+            } else {
+                const char* valueStart = q;
+                while (q < end && !isSpace(*q) && *q != '>') q++;
+                if (q >= end) return nullptr;
+                value = std::string_view(valueStart, q - valueStart);
+            }
+            bool wanted = equalsLower(attr, "href")
+                || (withSources && (equalsLower(attr, "src") || equalsLower(attr, "srcset")));
+            if (wanted && numLinks < 8) {
+                links[numLinks] = trim(value);
+                kinds[numLinks] = attr;
+                numLinks++;
+            }
+        }
+
+        for (int i = 0; i < numLinks; i++) {
+            if (links[i].empty()) continue;
+            if (isBase) {
+                if (base.empty() && equalsLower(kinds[i], "href")) base = std::string(links[i]);
+            } else if (equalsLower(kinds[i], "srcset")) {
+                splitSrcset(links[i], onLink);
+            } else {
+                onLink(links[i]);
+            }
+        }
+        if (equalsLower(tag, "script")) rawText = "</script";
+        else if (equalsLower(tag, "style")) rawText = "</style";
+        return q;
+    }
+
+    // Report the links between p and end, returns where an unfinished tag (or the end of
+    // the raw text, which can hold the start of its closing tag) begins, nullptr if none
+    template <class F>
+    const char* scanFrom(const char* p, const char* end, F& onLink) {
+        while (p < end) {
+            if (!rawText.empty()) {
+                const char* close = findLower(p, end, rawText);
+                if (!close) {
+                    return std::max(p, end - std::min<size_t>(end - p, rawText.size() - 1));
+                }
+                p = close;
+                rawText = std::string_view();
+            }
+            p = (const char*) memchr(p, '<', end - p);
+            if (!p) return nullptr;
+            const char* next = scanTag(p, end, onLink);
+            if (!next) return p;
+            p = next;
+        }
+        return nullptr;
+    }
+
+public:
+    explicit LinkScanner(bool withSources = false) : withSources(withSources) {}
+
+    // Call onLink(std::string_view) for every link of the page
+    template <class F>
+    void scan(const char* data, size_t size, F onLink) {
+        scanFrom(data, data + size, onLink); // A truncated tag at the end of the page is dropped
+    }
+
+    // Call onLink(std::string_view) for every link completed by the next chunk of the page
+    template <class F>
+    void feed(const char* data, size_t size, F onLink) {
+        const char* end = data + size;
+        // Complete the carried tag, one '>' at a time as it may hold quoted ones
+        while (!carry.empty() && data < end) {
+            const char* close = (const char*) memchr(data, '>', end - data);
+            const char* until = close ? close + 1 : end;
+            carry.append(data, until - data);
+            data = until;
+            const char* rest = scanFrom(carry.data(), carry.data() + carry.size(), onLink);
+            if (!rest) {
+                carry.clear();
+            } else if (carry.size() > MAX_CARRY) {
+                carry.clear();
+                rawText = std::string_view();
+            } else {
+                carry.erase(0, rest - carry.data());
+            }
+        }
+        if (data == end) return;
+        const char* rest = scanFrom(data, end, onLink);
+        if (rest) carry.assign(rest, end - rest);
+    }
+
+    // Target of the <base href> of the page, empty if there is none
+    const std::string& baseHref() const {
+        return base;
+    }
+};
@@ -0,0 +1,271 @@
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <cstdio>
+#include <cstdint>
+#include <curl/curl.h>
+
+// Crawl metrics
+// Every thread counts in its own cache line aligned block, registered the first time it counts,
+// so counting is a relaxed load and store with neither a lock nor a shared cache line. Readers sum
+// the blocks, which live as long as the process (the counts of finished threads are kept).
+// Durations are in nanoseconds.
+enum Counter {
+    PAGES_FETCHED,
+    FETCH_ERRORS,
+    BYTES_FETCHED,
+    PARSE_NS,
+    LINKS_FOUND,
+    SET_INSERT_NS,
+    URLS_ADDED,
+    SET_LOCK_WAIT_NS,  // Waiting for the set mutex and the stripe locks of the tables
+    POOL_LOCK_WAIT_NS, // Waiting for the task queues of the pool
+    DUPLICATE_PAGES,   // Pages whose links were skipped as their content was seen before
+    UNCHANGED_PAGES,   // Pages unchanged since the previous crawl, their links taken from the page cache
+    SKIPPED_NOT_HTML_PAGES,  // Transfers abandoned as their Content-Type was not HTML
+    SKIPPED_TOO_LARGE_PAGES, // Transfers abandoned as they were too large
+    OTHER_FETCHES,     // Transfers of what is not a page of the crawl (robots.txt), left out of the counts above
+    NUM_COUNTERS
+};
+
+class Metrics {
+public:
+    static const int MAX_STATUS = 600;
+
+private:
+    struct alignas(64) Block {
+        std::atomic<uint64_t> counters[NUM_COUNTERS];
+        std::atomic<uint64_t> curlErrors[CURL_LAST]; // By CURLcode
+        std::atomic<uint64_t> statuses[MAX_STATUS];   // By HTTP status
+
+        Block() {
+            for (auto& c : counters) c.store(0, std::memory_order_relaxed);
+            for (auto& c : curlErrors) c.store(0, std::memory_order_relaxed);
+            for (auto& c : statuses) c.store(0, std::memory_order_relaxed);
+        }
+    };
+
+    std::mutex lock;
+    std::vector<std::unique_ptr<Block>> blocks;
+
+    Block& local() {
+        static thread_local Block* block = nullptr;
+        if (!block) {
+            std::lock_guard<std::mutex> guard(lock);
+            blocks.emplace_back(new Block());
+            block = blocks.back().get();
+        }
+        return *block;
+    }
+
+    // Only the owning thread writes a block
+    static void bump(std::atomic<uint64_t>& c, uint64_t n) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    template <size_t N>
+    uint64_t sum(std::atomic<uint64_t> (Block::*array)[N], size_t i) {
+        std::lock_guard<std::mutex> guard(lock);
+        uint64_t total = 0;
+        for (const auto& block : blocks) {
+            total += ((*block).*array)[i].load(std::memory_order_relaxed);
+        }
+        return total;
+    }
+
+public:
+    void add(Counter counter, uint64_t n = 1) {
+        bump(local().counters[counter], n);
+    }
+
+    void curlError(CURLcode code) {
+        if (code >= 0 && code < CURL_LAST) bump(local().curlErrors[code], 1);
+    }
+
+    void httpStatus(long status) {
+        if (status >= 0 && status < MAX_STATUS) bump(local().statuses[status], 1);
+    }
+
+    uint64_t get(Counter counter) {
+        return sum(&Block::counters, counter);
+    }
+
+    uint64_t getCurlErrors(CURLcode code) {
+        return sum(&Block::curlErrors, code);
+    }
+
+    uint64_t getStatuses(long status) {
+        return sum(&Block::statuses, status);
+    }
+};
+
+Metrics metrics;
+
+// Adds the time from its construction to its destruction to a counter
+class ScopedTimer {
+private:
+    Counter counter;
+    std::chrono::steady_clock::time_point began;
+
+public:
+    explicit ScopedTimer(Counter counter) : counter(counter), began(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() {
+        metrics.add(counter, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - began).count());
+    }
+};
+
+// Lock m, adding the time spent waiting to counter (the clock is only read when m is taken)
+template <class M>
+void lockTimed(M& m, Counter counter) {
+    if (m.try_lock()) return;
+    ScopedTimer timer(counter);
+    m.lock();
+}
+
+// Periodic report of the metrics, one line on stderr and/or a file in the Prometheus text format
+// (written to a temporary file renamed over it, so a scraper never reads half of it).
+// Gauges are read from the crawl when reporting, e.g. the size of the frontier.
+class MetricsReporter {
+public:
+    typedef std::function<double()> Gauge;
+
+private:
+    struct NamedGauge {
+        std::string name;
+        std::string help;
+        Gauge read;
+    };
+
+    std::chrono::seconds interval;
+    bool toStderr;
+    std::string file;
+    std::vector<NamedGauge> gauges;
+    std::chrono::steady_clock::time_point began;
+    double lastElapsed;
+    uint64_t lastPages;
+    std::mutex lock;
+    std::condition_variable condition;
+    bool stopping;
+    std::thread thread;
+
+    template <class V>
+    static void counter(std::ostream& out, const std::string& name, const std::string& help, V value) {
+        out << "# HELP " << name << " " << help << "\n# TYPE " << name << " counter\n" << name << " " << value << "\n";
+    }
+
+    void writeFile() {
+        std::ostringstream out;
+        out.precision(12);
+        const double ns = 1e-9;
+        counter(out, "crawler_pages_fetched_total", "Pages fetched", metrics.get(PAGES_FETCHED));
+        counter(out, "crawler_bytes_fetched_total", "Bytes of the pages fetched", metrics.get(BYTES_FETCHED));
+        counter(out, "crawler_links_found_total", "Links found in the pages", metrics.get(LINKS_FOUND));
+        counter(out, "crawler_urls_added_total", "New URLs added to the set", metrics.get(URLS_ADDED));
+        counter(out, "crawler_skipped_not_html_total", "Transfers abandoned as they were not HTML",
+                metrics.get(SKIPPED_NOT_HTML_PAGES));
+        counter(out, "crawler_skipped_too_large_total", "Transfers abandoned as they were too large",
+                metrics.get(SKIPPED_TOO_LARGE_PAGES));
+        counter(out, "crawler_other_fetches_total", "Transfers of other resources than pages, such as robots.txt",
+                metrics.get(OTHER_FETCHES));
+        counter(out, "crawler_unchanged_pages_total", "Pages unchanged since the previous crawl", metrics.get(UNCHANGED_PAGES));
+        counter(out, "crawler_duplicate_pages_total", "Pages with the content of a page seen before", metrics.get(DUPLICATE_PAGES));
+        counter(out, "crawler_parse_seconds_total", "Time spent extracting links", metrics.get(PARSE_NS) * ns);
+        counter(out, "crawler_set_insert_seconds_total", "Time spent adding URLs to the set", metrics.get(SET_INSERT_NS) * ns);
+        counter(out, "crawler_set_lock_wait_seconds_total", "Time spent waiting for the locks of the set",
+                metrics.get(SET_LOCK_WAIT_NS) * ns);
+        counter(out, "crawler_pool_lock_wait_seconds_total", "Time spent waiting for the task queues",
+                metrics.get(POOL_LOCK_WAIT_NS) * ns);
+        out << "# HELP crawler_fetch_errors_total Failed transfers by CURLcode\n# TYPE crawler_fetch_errors_total counter\n";
+        for (int code = 1; code < CURL_LAST; code++) {
+            uint64_t n = metrics.getCurlErrors((CURLcode) code);
+            if (n > 0) out << "crawler_fetch_errors_total{code=\"" << code << "\"} " << n << "\n";
+        }
+        out << "# HELP crawler_http_responses_total Responses by HTTP status\n# TYPE crawler_http_responses_total counter\n";
+        for (long status = 0; status < Metrics::MAX_STATUS; status++) {
+            uint64_t n = metrics.getStatuses(status);
+            if (n > 0) out << "crawler_http_responses_total{status=\"" << status << "\"} " << n << "\n";
+        }
+        for (const NamedGauge& gauge : gauges) {
+            out << "# HELP " << gauge.name << " " << gauge.help << "\n# TYPE " << gauge.name << " gauge\n"
+                << gauge.name << " " << gauge.read() << "\n";
+        }
+
+        std::string temporary = file + ".tmp";
+        std::ofstream f(temporary, std::ios::trunc);
+        f << out.str();
+        f.close();
+        if (!f || std::rename(temporary.c_str(), file.c_str()) != 0) {
+            std::cerr << "Failed to write the metrics file " << file << std::endl;
+        }
+    }
+
+    void printLine() {
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - began).count();
+        uint64_t pages = metrics.get(PAGES_FETCHED);
+        const double ms = 1e-6;
+        std::ostringstream out;
+        out << "[metrics] " << (int) elapsed << " s: " << pages << " pages ("
+            << (elapsed > lastElapsed ? (pages - lastPages) / (elapsed - lastElapsed) : 0.0)
+            << "/s), " << metrics.get(BYTES_FETCHED) / 1000000.0 << " MB, " << metrics.get(FETCH_ERRORS) << " errors, "
+            << metrics.get(SKIPPED_NOT_HTML_PAGES) + metrics.get(SKIPPED_TOO_LARGE_PAGES) << " skipped, "
+            << metrics.get(DUPLICATE_PAGES) << " duplicates, " << metrics.get(UNCHANGED_PAGES) << " unchanged"
+            << ", parse " << metrics.get(PARSE_NS) * ms << " ms, set insert " << metrics.get(SET_INSERT_NS) * ms
+            << " ms, set lock wait " << metrics.get(SET_LOCK_WAIT_NS) * ms << " ms, pool lock wait "
+            << metrics.get(POOL_LOCK_WAIT_NS) * ms << " ms";
+        for (const NamedGauge& gauge : gauges) {
+            out << ", " << gauge.name << " " << gauge.read();
+        }
+        std::cerr << out.str() << std::endl;
+        lastPages = pages;
+        lastElapsed = elapsed;
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!condition.wait_for(guard, interval, [this]() { return stopping; })) {
+            report();
+        }
+    }
+
+public:
+    // Report every interval, on stderr if toStderr and in file if not empty
+    MetricsReporter(std::chrono::seconds interval, bool toStderr, const std::string& file)
+        : interval(interval), toStderr(toStderr), file(file), began(std::chrono::steady_clock::now()),
+          lastElapsed(0), lastPages(0), stopping(false) {}
+
+    // Reports a last time
+    ~MetricsReporter() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            condition.notify_one();
+        }
+        if (thread.joinable()) thread.join();
+        report();
+    }
+
+    // Gauges have to be added before start()
+    void addGauge(const std::string& name, const std::string& help, const Gauge& read) {
+        gauges.push_back(NamedGauge{name, help, read});
+    }
+
+    void start() {
+        thread = std::thread(&MetricsReporter::run, this);
+    }
+
+    void report() {
+        if (toStderr) printLine();
+        if (!file.empty()) writeFile();
+    }
+};
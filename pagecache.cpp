@@ -0,0 +1,151 @@
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <cstdio>
+#include <cstdint>
+
+// Pages of the previous crawl, to recrawl a site incrementally (needs fetcher.cpp)
+// For every URL: the validators of its last response (ETag, Last-Modified), the hash of its body
+// and its links to the site. Pages are then fetched with a conditional request, and the links of
+// a page which did not change (304, or the same body) are taken from here instead of parsing it.
+// The file is read at the start and rewritten at the end of the crawl with the pages it reached,
+// as records of: URL, ETag and Last-Modified (each length (uint32) prefixed), hash (uint64),
+// number of links (uint32) and the links (length prefixed).
+class PageCache {
+private:
+    struct Page {
+        std::string url;
+        Validators validators;
+        uint64_t hash; // 0 if unknown
+        std::vector<std::string> outlinks;
+        bool visited; // Reached by this crawl
+    };
+
+    std::string path;
+    std::mutex lock;
+    std::unordered_map<uint64_t, Page> pages; // By URL fingerprint
+
+    template <class V>
+    static void put(std::ostream& out, V value) {
+        out.write((const char*) &value, sizeof(value));
+    }
+
+    static void putString(std::ostream& out, const std::string& s) {
+        put(out, (uint32_t) s.size());
+        out.write(s.data(), s.size());
+    }
+
+    template <class V>
+    static bool get(std::istream& in, V& value) {
+        return (bool) in.read((char*) &value, sizeof(value));
+    }
+
+    // Bytes left before end
+    static std::streamoff left(std::istream& in, std::streamoff end) {
+        return end - (std::streamoff) in.tellg();
+    }
+
+    // A string no longer than what is left of the file, end being its size
+    static bool getString(std::istream& in, std::string& s, std::streamoff end) {
+        uint32_t length;
+        if (!get(in, length) || length > left(in, end)) return false;
+        s.resize(length);
+        return (bool) in.read(&s[0], length);
+    }
+
+public:
+    explicit PageCache(const std::string& path) : path(path) {}
+
+    // Read the pages of the previous crawl, if any, false if the file cannot be read or is corrupt
+    // (every size read is checked against the rest of the file before anything is allocated)
+    bool load() {
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in) return true; // First crawl
+        std::streamoff end = in.tellg();
+        in.seekg(0);
+        Page page;
+        page.visited = false;
+        uint32_t count;
+        while (in.peek() != EOF) {
+            bool ok = getString(in, page.url, end) && getString(in, page.validators.etag, end) &&
+                      getString(in, page.validators.lastModified, end) && get(in, page.hash) && get(in, count) &&
+                      count <= left(in, end) / sizeof(uint32_t);
+            if (ok) page.outlinks.resize(count);
+            for (uint32_t i = 0; i < count && ok; i++) {
+                ok = getString(in, page.outlinks[i], end);
+            }
+            if (!ok) {
+                std::cerr << "The page cache " << path << " is corrupt" << std::endl;
+                return false;
+            }
+            pages[urlFingerprint(page.url)] = page;
+        }
+        if (in.bad()) {
+            std::cerr << "Failed to read the page cache " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Write the pages reached by this crawl, false on failure
+    bool save() {
+        std::lock_guard<std::mutex> guard(lock);
+        std::string temporary = path + ".tmp";
+        std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+        for (const auto& entry : pages) {
+            const Page& page = entry.second;
+            if (!page.visited) continue;
+            putString(out, page.url);
+            putString(out, page.validators.etag);
+            putString(out, page.validators.lastModified);
+            put(out, page.hash);
+            put(out, (uint32_t) page.outlinks.size());
+            for (const std::string& link : page.outlinks) {
+                putString(out, link);
+            }
+        }
+        out.close();
+        if (!out || std::rename(temporary.c_str(), path.c_str()) != 0) {
+            std::cerr << "Failed to write the page cache " << path << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Validators to fetch url with, empty if it was not fetched before
+    Validators validators(const std::string& url) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = pages.find(urlFingerprint(url));
+        return it == pages.end() ? Validators() : it->second.validators;
+    }
+
+    // If the page at url did not change since the last crawl (the server answered 304, or the hash
+    // of its body is the same), get its links and keep it
+    bool unchanged(const std::string& url, const FetchResult& result, uint64_t hash, std::vector<std::string>& outlinks) {
+        std::lock_guard<std::mutex> guard(lock);
+        auto it = pages.find(urlFingerprint(url));
+        if (it == pages.end()) return false;
+        Page& page = it->second;
+        if (result.status != 304 && (hash == 0 || hash != page.hash || result.status < 200 || result.status >= 300)) {
+            return false;
+        }
+        if (result.status != 304) page.validators = result.validators;
+        page.visited = true;
+        outlinks = page.outlinks;
+        return true;
+    }
+
+    // The page at url was fetched (hash of its body 0 if unknown), with outlinks
+    void update(const std::string& url, const FetchResult& result, uint64_t hash, const std::vector<std::string>& outlinks) {
+        std::lock_guard<std::mutex> guard(lock);
+        Page& page = pages[urlFingerprint(url)];
+        page.url = url;
+        page.validators = result.validators;
+        page.hash = hash;
+        page.outlinks = outlinks;
+        page.visited = true;
+    }
+};
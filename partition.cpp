@@ -0,0 +1,453 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+// Distributed crawl over several processes (on one or several machines)
+// Every process owns the URLs whose fingerprint hashes to its rank, and only it adds them to its
+// set and fetches them. The links a process finds for another one are batched per peer and sent
+// over TCP every few milliseconds, the owner adding the new ones to its frontier.
+// The crawl is over when every process is idle and no URL is on the way. Rank 0 detects it with
+// waves of probes counting the URLs sent and received by every process (Mattern's four counter
+// method): two consecutive waves in which all processes are idle, with the same totals, and as
+// many URLs received as sent, mean no URL is in a buffer or a socket anymore. It then tells
+// everybody to stop.
+// Messages are a type, a payload length (uint32) and the payload:
+// 'U' URLs (length and depth prefixed), 'P' probe (wave), 'S' status (wave, idle, sent, received, URLs found),
+// 'T' terminate (failed). A connection starts with the rank of the process opening it.
+class CrawlPartition {
+public:
+    typedef std::function<void(const std::string& url, uint32_t depth)> Receive;
+    typedef std::function<bool()> Idle;
+    typedef std::function<size_t()> Found;
+
+private:
+    static constexpr size_t BATCH_BYTES = 64 * 1024;
+    static constexpr size_t MAX_MESSAGE_BYTES = 64 << 20; // Larger messages are corrupt
+    static constexpr std::chrono::milliseconds FLUSH_INTERVAL{10};
+    static constexpr std::chrono::milliseconds PROBE_INTERVAL{50};
+    static constexpr int CONNECT_SECONDS = 30;
+
+    struct Peer {
+        int out = -1; // Connection to send to the peer
+        std::mutex writeLock;
+        std::string batch; // URLs waiting to be sent
+    };
+
+    struct Status {
+        bool idle = true;
+        uint64_t sent = 0, received = 0, found = 0;
+    };
+
+    std::vector<std::string> addresses;
+    size_t rank;
+    int listener;
+    std::vector<std::unique_ptr<Peer>> peers;
+    std::vector<int> incoming;
+    std::vector<std::thread> readers;
+    std::thread sender;
+    std::thread detector;
+    Receive receive;
+    Idle idle;
+    Found found;
+    std::atomic<uint64_t> sent;
+    uint64_t received;
+    std::mutex stateLock; // Received URLs against status snapshots
+    std::mutex lock;
+    std::condition_variable condition;
+    bool flush;
+    bool stopping;
+    bool failed;
+    uint64_t wave;
+    size_t replies;
+    Status waveTotal;
+    uint64_t totalFound;
+
+    static bool splitAddress(const std::string& address, std::string& host, std::string& port) {
+        size_t colon = address.rfind(':');
+        if (colon == std::string::npos || colon == 0 || colon + 1 == address.size()) return false;
+        host = address.substr(0, colon);
+        port = address.substr(colon + 1);
+        return true;
+    }
+
+    // Socket listening on address, or connected to it, -1 on failure
+    static int openSocket(const std::string& address, bool listening) {
+        std::string host, port;
+        if (!splitAddress(address, host, port)) return -1;
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = listening ? AI_PASSIVE : 0;
+        addrinfo* results;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &results) != 0) return -1;
+        int fd = -1;
+        for (addrinfo* ai = results; ai && fd < 0; ai = ai->ai_next) {
+            fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+            if (fd < 0) continue;
+            int one = 1;
+            bool ok;
+            if (listening) {
+                setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+                ok = bind(fd, ai->ai_addr, ai->ai_addrlen) == 0 && listen(fd, 64) == 0;
+            } else {
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                ok = connect(fd, ai->ai_addr, ai->ai_addrlen) == 0;
+            }
+            if (!ok) {
+                close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(results);
+        return fd;
+    }
+
+    static bool writeAll(int fd, const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    static bool readAll(int fd, char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = recv(fd, data, size, 0);
+            if (n <= 0) return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    template <class V>
+    static void put(std::string& buffer, V value) {
+        buffer.append((const char*) &value, sizeof(value));
+    }
+
+    template <class V>
+    static V get(const std::string& buffer, size_t& offset) {
+        V value;
+        memcpy(&value, buffer.data() + offset, sizeof(value));
+        offset += sizeof(value);
+        return value;
+    }
+
+    bool sendMessage(size_t to, char type, const std::string& payload) {
+        Peer& peer = *peers[to];
+        std::string header(1, type);
+        put(header, (uint32_t) payload.size());
+        std::lock_guard<std::mutex> guard(peer.writeLock);
+        return writeAll(peer.out, header.data(), header.size()) && writeAll(peer.out, payload.data(), payload.size());
+    }
+
+    Status snapshot() {
+        std::lock_guard<std::mutex> guard(stateLock);
+        Status status;
+        status.idle = idle();
+        status.sent = sent.load();
+        status.received = received;
+        status.found = found();
+        return status;
+    }
+
+    // Stop the crawl (lock held)
+    void stop(bool failure) {
+        failed = failed || failure;
+        stopping = true;
+        condition.notify_all();
+    }
+
+    // Rank 0 tells the others to stop
+    void terminate(bool failure) {
+        std::string payload;
+        put(payload, (uint8_t) failure);
+        for (size_t i = 1; i < peers.size(); i++) {
+            sendMessage(i, 'T', payload);
+        }
+    }
+
+    void sendBatches() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (!stopping) {
+            condition.wait_for(guard, FLUSH_INTERVAL, [this]() { return flush || stopping; });
+            flush = false;
+            std::vector<std::string> batches(peers.size());
+            for (size_t i = 0; i < peers.size(); i++) {
+                batches[i].swap(peers[i]->batch);
+            }
+            guard.unlock();
+            for (size_t i = 0; i < peers.size(); i++) {
+                if (!batches[i].empty() && !sendMessage(i, 'U', batches[i])) {
+                    std::cerr << "Failed to send URLs to peer " << addresses[i] << std::endl;
+                }
+            }
+            guard.lock();
+        }
+    }
+
+    // Whether a message of the type can have a payload of size bytes
+    static bool wellFormed(char type, uint32_t size) {
+        switch (type) {
+        case 'U': return size <= MAX_MESSAGE_BYTES;
+        case 'P': return size == sizeof(uint64_t);
+        case 'S': return size == sizeof(uint64_t) + sizeof(uint8_t) + 3 * sizeof(uint64_t);
+        case 'T': return size == sizeof(uint8_t);
+        default: return false;
+        }
+    }
+
+    // Read the messages of a peer until it closes the connection, which is dropped if a message is malformed
+    void read(int fd) {
+        uint32_t from;
+        bool ok = readAll(fd, (char*) &from, sizeof(from));
+        std::string payload;
+        while (ok) {
+            char header[1 + sizeof(uint32_t)];
+            if (!readAll(fd, header, sizeof(header))) break;
+            uint32_t size;
+            memcpy(&size, header + 1, sizeof(size));
+            if (!wellFormed(header[0], size)) {
+                std::cerr << "Malformed message from peer " << from << std::endl;
+                ok = false;
+                break;
+            }
+            payload.resize(size);
+            if (!readAll(fd, &payload[0], size)) break;
+            size_t offset = 0;
+            if (header[0] == 'U') {
+                std::lock_guard<std::mutex> guard(stateLock);
+                while (offset < payload.size()) {
+                    if (offset + 2 * sizeof(uint32_t) > payload.size()) {
+                        ok = false;
+                        break;
+                    }
+                    uint32_t length = get<uint32_t>(payload, offset);
+                    uint32_t depth = get<uint32_t>(payload, offset);
+                    if (length > payload.size() - offset) {
+                        ok = false;
+                        break;
+                    }
+                    receive(payload.substr(offset, length), depth);
+                    offset += length;
+                    received++;
+                }
+                if (!ok) {
+                    std::cerr << "Corrupt URLs from peer " << from << std::endl;
+                    break;
+                }
+            } else if (header[0] == 'P') {
+                uint64_t id = get<uint64_t>(payload, offset);
+                Status status = snapshot();
+                std::string reply;
+                put(reply, id);
+                put(reply, (uint8_t) status.idle);
+                put(reply, status.sent);
+                put(reply, status.received);
+                put(reply, status.found);
+                sendMessage(0, 'S', reply);
+            } else if (header[0] == 'S') {
+                uint64_t id = get<uint64_t>(payload, offset);
+                std::lock_guard<std::mutex> guard(lock);
+                if (id != wave) continue;
+                waveTotal.idle = get<uint8_t>(payload, offset) && waveTotal.idle;
+                waveTotal.sent += get<uint64_t>(payload, offset);
+                waveTotal.received += get<uint64_t>(payload, offset);
+                waveTotal.found += get<uint64_t>(payload, offset);
+                replies++;
+                condition.notify_all();
+            } else if (header[0] == 'T') {
+                std::lock_guard<std::mutex> guard(lock);
+                stop(get<uint8_t>(payload, offset) != 0);
+                return;
+            }
+        }
+        // The URLs of a malformed message are lost, the crawl cannot complete
+        if (!ok) shutdown(fd, SHUT_RDWR);
+        // Rank 0 only closes after sending 'T', and detects the loss of any other process
+        std::lock_guard<std::mutex> guard(lock);
+        if (!stopping && (rank == 0 || !ok || from == 0)) {
+            std::cerr << "Lost the connection to a peer, stopping the crawl" << std::endl;
+            stop(true);
+            if (rank == 0) terminate(true);
+        }
+    }
+
+    void detect() {
+        Status previous;
+        bool hasPrevious = false;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                if (condition.wait_for(guard, PROBE_INTERVAL, [this]() { return stopping; })) return;
+                wave++;
+                replies = 0;
+            }
+            Status local = snapshot();
+            std::string probe;
+            {
+                std::lock_guard<std::mutex> guard(lock);
+                waveTotal = local;
+                put(probe, wave);
+            }
+            for (size_t i = 1; i < peers.size(); i++) {
+                sendMessage(i, 'P', probe);
+            }
+            Status total;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                condition.wait(guard, [this]() { return replies + 1 == peers.size() || stopping; });
+                if (stopping) return;
+                total = waveTotal;
+            }
+            if (hasPrevious && previous.idle && total.idle && previous.sent == previous.received
+                && total.sent == previous.sent && total.received == previous.received) {
+                {
+                    std::lock_guard<std::mutex> guard(lock);
+                    totalFound = total.found;
+                    stop(false);
+                }
+                terminate(false);
+                return;
+            }
+            previous = total;
+            hasPrevious = true;
+        }
+    }
+
+public:
+    // Process rank of the processes listening on addresses ("host:port"), listens right away
+    CrawlPartition(const std::vector<std::string>& addresses, size_t rank)
+        : addresses(addresses), rank(rank), sent(0), received(0), flush(false), stopping(false), failed(false),
+          wave(0), replies(0), totalFound(0) {
+        for (size_t i = 0; i < addresses.size(); i++) {
+            peers.emplace_back(new Peer());
+        }
+        listener = openSocket(addresses[rank], true);
+        if (listener < 0) {
+            std::cerr << "Failed to listen on " << addresses[rank] << std::endl;
+        }
+    }
+
+    CrawlPartition(const CrawlPartition&) = delete;
+    CrawlPartition& operator=(const CrawlPartition&) = delete;
+
+    ~CrawlPartition() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop(false);
+        }
+        if (detector.joinable()) detector.join();
+        if (sender.joinable()) sender.join();
+        for (const std::unique_ptr<Peer>& peer : peers) {
+            if (peer->out >= 0) shutdown(peer->out, SHUT_RDWR);
+        }
+        for (int fd : incoming) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        for (std::thread& reader : readers) {
+            reader.join();
+        }
+        for (const std::unique_ptr<Peer>& peer : peers) {
+            if (peer->out >= 0) close(peer->out);
+        }
+        for (int fd : incoming) {
+            close(fd);
+        }
+        if (listener >= 0) close(listener);
+    }
+
+    // Rank of the process owning url
+    // The fingerprint is mixed again, the sets and the Bloom filter of every process use its bits too
+    size_t owner(std::string_view url) const {
+        return finishHash(urlFingerprint(url) + 0x9E3779B97F4A7C15ULL) % addresses.size();
+    }
+
+    bool owns(std::string_view url) const {
+        return owner(url) == rank;
+    }
+
+    // Connect to the peers and start exchanging URLs, once the initial URLs of the process are queued:
+    // receive gets the URLs of the process found by the others, idle tells if it has nothing left to
+    // do on its own and found how many URLs it has. false if the peers cannot be reached.
+    bool start(const Receive& receive, const Idle& idle, const Found& found) {
+        this->receive = receive;
+        this->idle = idle;
+        this->found = found;
+        if (listener < 0) return false;
+        uint32_t self = (uint32_t) rank;
+        for (size_t i = 0; i < addresses.size(); i++) {
+            if (i == rank) continue;
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(CONNECT_SECONDS);
+            while ((peers[i]->out = openSocket(addresses[i], false)) < 0 && std::chrono::steady_clock::now() < deadline) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            }
+            if (peers[i]->out < 0 || !writeAll(peers[i]->out, (const char*) &self, sizeof(self))) {
+                std::cerr << "Failed to connect to peer " << addresses[i] << std::endl;
+                return false;
+            }
+        }
+        timeval timeout{CONNECT_SECONDS, 0};
+        setsockopt(listener, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        while (incoming.size() + 1 < addresses.size()) {
+            int fd = accept(listener, nullptr, nullptr);
+            if (fd < 0) {
+                std::cerr << "Failed to accept the connections of the peers" << std::endl;
+                return false;
+            }
+            incoming.push_back(fd);
+            readers.emplace_back(&CrawlPartition::read, this, fd);
+        }
+        sender = std::thread(&CrawlPartition::sendBatches, this);
+        if (rank == 0) {
+            detector = std::thread(&CrawlPartition::detect, this);
+        }
+        return true;
+    }
+
+    // Send url, found at depth, to its owner
+    void forward(const std::string& url, uint32_t depth) {
+        size_t to = owner(url);
+        std::lock_guard<std::mutex> guard(lock);
+        std::string& batch = peers[to]->batch;
+        put(batch, (uint32_t) url.size());
+        put(batch, depth);
+        batch.append(url);
+        sent++;
+        if (batch.size() >= BATCH_BYTES && !flush) {
+            flush = true;
+            condition.notify_all();
+        }
+    }
+
+    // Block until the crawl is over everywhere, false if a process was lost on the way
+    bool waitForTermination() {
+        std::unique_lock<std::mutex> guard(lock);
+        condition.wait(guard, [this]() { return stopping; });
+        return !failed;
+    }
+
+    // Number of URLs found by all the processes, known by rank 0 at the end of the crawl
+    uint64_t getTotalFound() const {
+        return totalFound;
+    }
+};
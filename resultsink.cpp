@@ -0,0 +1,150 @@
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdint>
+
+// Results of the crawl written while it runs, one record per page processed (needs fetcher.cpp):
+// its URL, HTTP status (0 if the fetch failed), size, depth (links followed from the seed), fetch
+// time, why it was abandoned if it was (see SkipReason) and the links of the page to URLs of the
+// site, normalized, in the order of the page.
+// Workers encode their record and append it to a buffer in memory, which a background thread
+// writes out every interval or as soon as it holds FLUSH_BYTES, so the output is written in large
+// blocks and never flushed per page.
+// Formats: JSONL, one object per line
+//   {"url":"...","status":200,"bytes":1234,"depth":1,"fetch_ms":12.345,"outlinks":["...",...]}
+// with "skipped":"not_html" or "too_large" after fetch_ms for an abandoned page,
+// or binary, records of little-endian fields:
+//   url length (uint32), url, status (uint16), skip reason (uint8, 0 if not skipped), bytes (uint64),
+//   depth (uint32), fetch time in microseconds (uint32), number of outlinks (uint32), then the
+//   outlinks as url length, url
+class ResultSink {
+public:
+    enum Format { JSONL, BINARY };
+
+private:
+    static constexpr size_t FLUSH_BYTES = 1 << 20;
+
+    std::ofstream out;
+    Format format;
+    std::string buffer;
+    std::mutex lock;
+    std::condition_variable condition;
+    bool stopping;
+    std::chrono::milliseconds interval;
+    std::thread writer;
+
+    template <class V>
+    static void put(std::string& record, V value) {
+        record.append((const char*) &value, sizeof(value));
+    }
+
+    static void putString(std::string& record, const std::string& s) {
+        put(record, (uint32_t) s.size());
+        record.append(s);
+    }
+
+    static void appendJSON(std::string& record, const std::string& s) {
+        static const char digits[] = "0123456789abcdef";
+        record.push_back('"');
+        for (unsigned char c : s) {
+            if (c == '"' || c == '\\') {
+                record.push_back('\\');
+                record.push_back((char) c);
+            } else if (c < 0x20) {
+                record.append("\\u00");
+                record.push_back(digits[c >> 4]);
+                record.push_back(digits[c & 15]);
+            } else {
+                record.push_back((char) c);
+            }
+        }
+        record.push_back('"');
+    }
+
+    void encode(std::string& record, const std::string& url, const FetchResult& result, uint32_t depth,
+                const std::vector<std::string>& outlinks) const {
+        if (format == BINARY) {
+            putString(record, url);
+            put(record, (uint16_t) result.status);
+            put(record, (uint8_t) result.skipped);
+            put(record, (uint64_t) result.bytes);
+            put(record, depth);
+            put(record, (uint32_t) (result.seconds * 1e6));
+            put(record, (uint32_t) outlinks.size());
+            for (const std::string& link : outlinks) {
+                putString(record, link);
+            }
+            return;
+        }
+        char numbers[160];
+        snprintf(numbers, sizeof(numbers), ",\"status\":%ld,\"bytes\":%lld,\"depth\":%u,\"fetch_ms\":%.3f%s%s%s,\"outlinks\":[",
+                 result.status, (long long) result.bytes, depth, result.seconds * 1e3,
+                 result.skipped ? ",\"skipped\":\"" : "", skipReasonName(result.skipped), result.skipped ? "\"" : "");
+        record.append("{\"url\":");
+        appendJSON(record, url);
+        record.append(numbers);
+        for (size_t i = 0; i < outlinks.size(); i++) {
+            if (i > 0) record.push_back(',');
+            appendJSON(record, outlinks[i]);
+        }
+        record.append("]}\n");
+    }
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            condition.wait_for(guard, interval, [this]() { return stopping || buffer.size() >= FLUSH_BYTES; });
+            std::string batch;
+            batch.swap(buffer);
+            bool last = stopping;
+            guard.unlock();
+            out.write(batch.data(), batch.size());
+            out.flush();
+            if (!out) {
+                std::cerr << "Failed to write the results" << std::endl;
+            }
+            guard.lock();
+            if (last) return;
+        }
+    }
+
+public:
+    // Write to path, appending to it if append (a resumed crawl)
+    ResultSink(const std::string& path, Format format, std::chrono::milliseconds interval, bool append)
+        : out(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc)), format(format),
+          stopping(false), interval(interval) {
+        if (!out) {
+            std::cerr << "Failed to open the results file " << path << std::endl;
+        }
+        writer = std::thread(&ResultSink::run, this);
+    }
+
+    // Writes what is left
+    ~ResultSink() {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stopping = true;
+            condition.notify_one();
+        }
+        writer.join();
+    }
+
+    bool isOpen() const {
+        return out.is_open();
+    }
+
+    // The page at url, found at depth, has been processed
+    void record(const std::string& url, const FetchResult& result, uint32_t depth, const std::vector<std::string>& outlinks) {
+        std::string record;
+        encode(record, url, result, depth, outlinks);
+        std::lock_guard<std::mutex> guard(lock);
+        buffer.append(record);
+        if (buffer.size() >= FLUSH_BYTES) condition.notify_one();
+    }
+};
@@ -0,0 +1,235 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <sstream>
+#include <unordered_map>
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+// Path and query of a URL, which robots.txt rules are matched against ("/" if empty)
+std::string_view pathOf(std::string_view url) {
+    size_t start = url.find("://");
+    start = start == std::string_view::npos ? 0 : start + 3;
+    size_t path = url.find_first_of("/?#", start);
+    if (path == std::string_view::npos || url[path] == '#') return "/";
+    return url.substr(path, url.find('#', path) - path);
+}
+
+// Allow/Disallow rules of a robots.txt for one user agent (https://www.rfc-editor.org/rfc/rfc9309)
+// The longest matching pattern decides, Allow winning ties. Plain patterns (the vast majority) are
+// compiled in a prefix trie walked once along the path, so a check costs one pass over the path
+// whatever the number of rules. Patterns with '*' or '$' are matched one by one.
+class RobotsRules {
+private:
+    struct Node {
+        std::vector<std::pair<char, int>> children;
+        int rule = -1; // 1 Allow, 0 Disallow, -1 no pattern ends here
+    };
+
+    struct Wildcard {
+        std::string pattern;
+        bool allow;
+    };
+
+    std::vector<Node> trie;
+    std::vector<Wildcard> wildcards;
+    std::chrono::milliseconds crawlDelay;
+
+    // Match of a pattern with '*' (any sequence) and a final '$' (end of the path)
+    static bool matchWildcard(std::string_view pattern, std::string_view path) {
+        size_t p = 0, s = 0, star = std::string_view::npos, mark = 0;
+        bool anchored = !pattern.empty() && pattern.back() == '$';
+        if (anchored) pattern.remove_suffix(1);
+        while (s < path.size()) {
+            if (p < pattern.size() && pattern[p] == '*') {
+                star = p++;
+                mark = s;
+            } else if (p < pattern.size() && pattern[p] == path[s]) {
+                p++;
+                s++;
+            } else if (p == pattern.size() && !anchored) {
+                return true;
+            } else if (star != std::string_view::npos) {
+                p = star + 1;
+                s = ++mark;
+            } else {
+                return false;
+            }
+        }
+        while (p < pattern.size() && pattern[p] == '*') p++;
+        return p == pattern.size();
+    }
+
+public:
+    RobotsRules() : trie(1), crawlDelay(0) {}
+
+    void add(const std::string& pattern, bool allow) {
+        if (pattern.find_first_of("*$") != std::string::npos) {
+            wildcards.push_back(Wildcard{pattern, allow});
+            return;
+        }
+        int node = 0;
+        for (char c : pattern) {
+            int next = -1;
+            for (auto& child : trie[node].children) {
+                if (child.first == c) next = child.second;
+            }
+            if (next < 0) {
+                next = (int) trie.size();
+                trie[node].children.emplace_back(c, next);
+                trie.emplace_back();
+            }
+            node = next;
+        }
+        // Allow wins over a Disallow of the same pattern
+        trie[node].rule = std::max(trie[node].rule, allow ? 1 : 0);
+    }
+
+    void setCrawlDelay(std::chrono::milliseconds delay) {
+        crawlDelay = delay;
+    }
+
+    // Crawl-delay of the group, 0 if none
+    std::chrono::milliseconds getCrawlDelay() const {
+        return crawlDelay;
+    }
+
+    // Whether the path (with its query, starting with '/') may be crawled
+    bool allowed(std::string_view path) const {
+        size_t bestLength = 0;
+        bool allow = true;
+        int node = 0;
+        for (size_t i = 0; ; i++) {
+            if (trie[node].rule >= 0 && i > 0 && (i > bestLength || (i == bestLength && trie[node].rule == 1))) {
+                bestLength = i;
+                allow = trie[node].rule == 1;
+            }
+            if (i == path.size()) break;
+            int next = -1;
+            for (auto& child : trie[node].children) {
+                if (child.first == path[i]) next = child.second;
+            }
+            if (next < 0) break;
+            node = next;
+        }
+        for (const Wildcard& w : wildcards) {
+            size_t length = w.pattern.size();
+            if ((length > bestLength || (length == bestLength && w.allow)) && matchWildcard(w.pattern, path)) {
+                bestLength = length;
+                allow = w.allow;
+            }
+        }
+        return allow;
+    }
+
+    // Keep the groups of robots.txt which apply to agent (lowercase product token),
+    // or the ones for "*" if none names it
+    // A group names the agent by its product token, compared whole and case insensitively, so that
+    // "crawler" or an empty User-agent line do not select the groups of "parallel-web-crawler".
+    static RobotsRules parse(const std::string& text, const std::string& agent) {
+        struct Group {
+            std::vector<std::string> agents;
+            std::vector<std::pair<std::string, bool>> rules;
+            long delay = -1;
+        };
+        std::vector<Group> groups;
+        bool inAgents = false;
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line)) {
+            line = line.substr(0, line.find('#'));
+            size_t colon = line.find(':');
+            if (colon == std::string::npos) continue;
+            std::string field = line.substr(0, colon);
+            std::string value = line.substr(colon + 1);
+            auto trim = [](std::string& s) {
+                s.erase(0, s.find_first_not_of(" \t\r"));
+                s.erase(s.find_last_not_of(" \t\r") + 1);
+            };
+            trim(field);
+            trim(value);
+            for (char& c : field) c = (char) tolower(c);
+            if (field == "user-agent") {
+                if (!inAgents) groups.emplace_back();
+                for (char& c : value) c = (char) tolower(c);
+                if (!value.empty()) groups.back().agents.push_back(value);
+                inAgents = true;
+                continue;
+            }
+            inAgents = false;
+            if (groups.empty()) continue;
+            if (field == "allow" || field == "disallow") {
+                if (!value.empty()) groups.back().rules.emplace_back(value, field == "allow");
+            } else if (field == "crawl-delay") {
+                groups.back().delay = (long) (atof(value.c_str()) * 1000);
+            }
+        }
+
+        bool named = false;
+        for (const Group& g : groups) {
+            for (const std::string& a : g.agents) {
+                if (a == agent) named = true;
+            }
+        }
+        RobotsRules rules;
+        for (const Group& g : groups) {
+            bool applies = false;
+            for (const std::string& a : g.agents) {
+                applies = applies || a == (named ? agent : "*");
+            }
+            if (!applies) continue;
+            for (const auto& rule : g.rules) rules.add(rule.first, rule.second);
+            if (g.delay >= 0) rules.setCrawlDelay(std::chrono::milliseconds(g.delay));
+        }
+        return rules;
+    }
+
+    // Rules of a site whose robots.txt could not be read: everything is disallowed
+    static RobotsRules disallowAll() {
+        RobotsRules rules;
+        rules.add("/", false);
+        return rules;
+    }
+};
+
+// robots.txt of every host, fetched the first time a host is asked for
+class RobotsCache {
+private:
+    struct Entry {
+        std::once_flag fetched;
+        RobotsRules rules;
+    };
+
+    std::string agent;
+    std::mutex lock;
+    std::unordered_map<std::string, std::shared_ptr<Entry>> hosts;
+
+public:
+    RobotsCache(const std::string& agent) : agent(agent) {}
+
+    // Rules of host ("https://host:port"), valid as long as the cache
+    // Missing robots.txt (4xx) allows everything, an unreachable one (5xx, network error) nothing
+    const RobotsRules& rulesFor(const std::string& host) {
+        std::shared_ptr<Entry> entry;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            std::shared_ptr<Entry>& slot = hosts[host];
+            if (!slot) slot = std::make_shared<Entry>();
+            entry = slot;
+        }
+        std::call_once(entry->fetched, [this, &host, &entry]() {
+            long status = 0;
+            std::string text = fetchHTML(host + "/robots.txt", status);
+            if (status >= 200 && status < 300) {
+                entry->rules = RobotsRules::parse(text, agent);
+            } else if (status < 400 || status >= 500) {
+                entry->rules = RobotsRules::disallowAll();
+            }
+        });
+        return entry->rules;
+    }
+};
@@ -0,0 +1,328 @@
+#include <string>
+#include <deque>
+#include <vector>
+#include <queue>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <condition_variable>
+#include <unistd.h>
+
+// Scheme and authority of a URL ("https://host:port"), which identify the server
+std::string hostOf(const std::string& url) {
+    size_t start = url.find("://");
+    start = start == std::string::npos ? 0 : start + 3;
+    size_t end = url.find_first_of("/?#", start);
+    return url.substr(0, end);
+}
+
+// Per host politeness scheduler
+// URLs wait in one queue per host and are released to the fetcher (dispatch) while the host has
+// less than maxPerHost transfers in flight and at least its delay has passed since the last one
+// started. Hosts which have to wait for their delay are kept in a priority queue ordered by the
+// time they become ready, and a dispatcher thread sleeps until the earliest of them.
+// At most maxInFlight URLs are dispatched at once overall, hosts held back by this limit wait
+// their turn in a FIFO, so the queues here are the crawl frontier and the fetcher only holds
+// what it is transferring. With a spill directory, each host queue keeps window URLs in memory
+// and the rest on disk (see SpillQueue). With a score (setOrder), each host queue is instead a
+// PriorityFrontier which releases its best URL first.
+// URLs which will never be dispatched are counted to the drop callback: the ones lost with a
+// spill segment, and with a budget (setBudget), the ones left once it is exhausted. Every URL
+// released takes a page from the budget. Once it is exhausted, or its time limit has passed, the
+// queues are emptied and every URL queued or pushed afterwards is dropped, while the transfers
+// in flight finish.
+// A 0 maxPerHost, delay or maxInFlight means no limit.
+class HostScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+    typedef std::function<void(const FrontierEntry& entry)> Dispatch;
+    typedef std::function<void(size_t count)> Drop;
+
+private:
+    struct Host {
+        SpillQueue urls;         // Without a score
+        PriorityFrontier ranked; // With a score
+        size_t inFlight = 0;
+        Clock::time_point nextStart;
+        std::chrono::milliseconds delay;
+        bool waiting = false; // in the timer queue
+        bool blocked = false; // in the queue of hosts waiting for the overall limit
+
+        bool empty() const {
+            return urls.empty() && ranked.empty();
+        }
+
+        size_t size() const {
+            return urls.size() + ranked.size();
+        }
+
+        // False if no URL is left, adds the URLs lost on the way to lost
+        bool pop(FrontierEntry& entry, size_t& lost) {
+            if (ranked.empty()) {
+                bool popped = urls.pop_front(entry);
+                lost += urls.takeLost();
+                return popped;
+            }
+            entry = ranked.pop_front();
+            return true;
+        }
+    };
+
+    typedef std::pair<Clock::time_point, std::string> Timer;
+
+    size_t maxPerHost;
+    std::chrono::milliseconds defaultDelay;
+    size_t maxInFlight;
+    size_t inFlight;
+    Dispatch dispatch;
+    Drop drop;
+    std::string spillDir;
+    size_t window;
+    FrontierScore score;
+    CrawlBudget* budget;
+    bool closed;
+    size_t numDropped;
+    size_t numLost;
+    size_t dropping; // Dropped or lost, to count to drop once the lock is released
+    std::unordered_map<std::string, Host> hosts;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    std::deque<std::string> blocked;
+    std::mutex lock;
+    std::condition_variable condition;
+    bool stopping;
+    std::thread dispatcher;
+
+    Host& hostFor(const std::string& name);
+    void release(const std::string& name, Host& host, std::vector<FrontierEntry>& ready);
+    void close();
+    void hand(std::unique_lock<std::mutex>& guard, std::vector<FrontierEntry>& ready);
+    void run();
+
+public:
+    HostScheduler(size_t maxPerHost, std::chrono::milliseconds delay, size_t maxInFlight, const Dispatch& dispatch,
+                  const Drop& drop, const std::string& spillDir = "", size_t window = 0);
+    ~HostScheduler();
+    void setOrder(FrontierScore score);
+    void setBudget(CrawlBudget* budget);
+    void push(const std::string& url, uint32_t depth);
+    void done(const std::string& url);
+    void setDelay(const std::string& host, std::chrono::milliseconds delay);
+    size_t size();
+    size_t dispatched();
+    size_t dropped();
+    size_t lost();
+};
+
+HostScheduler::HostScheduler(size_t maxPerHost, std::chrono::milliseconds delay, size_t maxInFlight,
+                             const Dispatch& dispatch, const Drop& drop, const std::string& spillDir, size_t window)
+    : maxPerHost(maxPerHost), defaultDelay(delay), maxInFlight(maxInFlight), inFlight(0), dispatch(dispatch), drop(drop),
+      spillDir(spillDir), window(window), score(nullptr), budget(nullptr), closed(false), numDropped(0), numLost(0),
+      dropping(0), stopping(false) {
+    dispatcher = std::thread(&HostScheduler::run, this);
+}
+
+HostScheduler::~HostScheduler() {
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        stopping = true;
+        condition.notify_all();
+    }
+    dispatcher.join();
+}
+
+HostScheduler::Host& HostScheduler::hostFor(const std::string& name) {
+    auto it = hosts.find(name);
+    if (it == hosts.end()) {
+        it = hosts.try_emplace(name).first;
+        it->second.delay = defaultDelay;
+        it->second.ranked.setScore(score);
+        if (!spillDir.empty()) {
+            it->second.urls.configure(spillDir + "/frontier-" + std::to_string(getpid()) + "-"
+                                      + std::to_string(hosts.size()) + "-", window);
+        }
+    }
+    return it->second;
+}
+
+// Take the URLs the host can start now, or arm its timer (lock held)
+void HostScheduler::release(const std::string& name, Host& host, std::vector<FrontierEntry>& ready) {
+    Clock::time_point now = Clock::now();
+    while (!host.empty() && (maxPerHost == 0 || host.inFlight < maxPerHost)) {
+        if (maxInFlight > 0 && inFlight >= maxInFlight) {
+            if (!host.blocked) {
+                host.blocked = true;
+                blocked.push_back(name);
+            }
+            return;
+        }
+        if (now < host.nextStart) {
+            if (!host.waiting) {
+                host.waiting = true;
+                timers.emplace(host.nextStart, name);
+                condition.notify_one();
+            }
+            return;
+        }
+        FrontierEntry entry;
+        size_t lost = 0;
+        bool popped = host.pop(entry, lost);
+        numLost += lost;
+        dropping += lost;
+        if (!popped) return;
+        if (budget && !budget->takePage()) {
+            numDropped++;
+            dropping++;
+            close();
+            return;
+        }
+        ready.push_back(std::move(entry));
+        host.inFlight++;
+        inFlight++;
+        host.nextStart = now + host.delay;
+    }
+}
+
+// The budget is exhausted: drop every URL queued and the ones pushed from now on (lock held)
+void HostScheduler::close() {
+    closed = true;
+    for (auto& it : hosts) {
+        Host& host = it.second;
+        FrontierEntry entry;
+        size_t lost = 0;
+        while (host.pop(entry, lost)) {
+            numDropped++;
+            dropping++;
+        }
+        numLost += lost;
+        dropping += lost;
+    }
+}
+
+// Release the lock to dispatch the URLs ready and count the ones dropped, then take it back
+void HostScheduler::hand(std::unique_lock<std::mutex>& guard, std::vector<FrontierEntry>& ready) {
+    if (ready.empty() && dropping == 0) return;
+    size_t dropped = dropping;
+    dropping = 0;
+    guard.unlock();
+    for (const FrontierEntry& entry : ready) dispatch(entry);
+    if (dropped > 0) drop(dropped);
+    guard.lock();
+}
+
+// Order each host queue by score (nullptr for FIFO), before any URL is pushed
+void HostScheduler::setOrder(FrontierScore score) {
+    std::unique_lock<std::mutex> guard(lock);
+    this->score = score;
+}
+
+// Take a page from budget for every URL released, and drop the URLs left once it is exhausted
+void HostScheduler::setBudget(CrawlBudget* budget) {
+    std::unique_lock<std::mutex> guard(lock);
+    this->budget = budget;
+    condition.notify_one(); // Wake the dispatcher up at the time limit
+}
+
+// Queue a URL for its host
+void HostScheduler::push(const std::string& url, uint32_t depth) {
+    std::vector<FrontierEntry> ready;
+    std::unique_lock<std::mutex> guard(lock);
+    std::string name = hostOf(url);
+    Host& host = hostFor(name);
+    if (closed) {
+        numDropped++;
+        dropping++;
+    } else {
+        if (score) {
+            host.ranked.push_back(FrontierEntry{url, depth});
+        } else {
+            host.urls.push_back(FrontierEntry{url, depth});
+        }
+        if (!host.waiting) release(name, host, ready);
+    }
+    hand(guard, ready);
+}
+
+// The transfer of a dispatched URL is over, its host can start another one
+void HostScheduler::done(const std::string& url) {
+    std::vector<FrontierEntry> ready;
+    std::unique_lock<std::mutex> guard(lock);
+    std::string name = hostOf(url);
+    Host& host = hostFor(name);
+    host.inFlight--;
+    inFlight--;
+    if (!host.waiting) release(name, host, ready);
+    // Hand the freed slots to the hosts which were held back by the overall limit
+    while (!blocked.empty() && (maxInFlight == 0 || inFlight < maxInFlight)) {
+        std::string other = blocked.front();
+        blocked.pop_front();
+        Host& h = hostFor(other);
+        h.blocked = false;
+        if (!h.waiting) release(other, h, ready);
+    }
+    hand(guard, ready);
+}
+
+// Minimum time between two requests to the host (e.g. its robots.txt Crawl-delay)
+void HostScheduler::setDelay(const std::string& name, std::chrono::milliseconds delay) {
+    std::unique_lock<std::mutex> guard(lock);
+    hostFor(name).delay = delay;
+}
+
+// Number of URLs waiting in the queues (the frontier)
+size_t HostScheduler::size() {
+    std::unique_lock<std::mutex> guard(lock);
+    size_t total = 0;
+    for (const auto& host : hosts) {
+        total += host.second.size();
+    }
+    return total;
+}
+
+// Number of URLs dispatched whose transfer is not over
+size_t HostScheduler::dispatched() {
+    std::unique_lock<std::mutex> guard(lock);
+    return inFlight;
+}
+
+// Number of URLs dropped as the budget was exhausted
+size_t HostScheduler::dropped() {
+    std::unique_lock<std::mutex> guard(lock);
+    return numDropped;
+}
+
+// Number of URLs lost with their spill segment
+size_t HostScheduler::lost() {
+    std::unique_lock<std::mutex> guard(lock);
+    return numLost;
+}
+
+void HostScheduler::run() {
+    std::unique_lock<std::mutex> guard(lock);
+    while (!stopping) {
+        Clock::time_point now = Clock::now();
+        bool timed = budget && !closed && budget->getDeadline() != Clock::time_point::max();
+        std::vector<FrontierEntry> ready;
+        if (timed && now >= budget->getDeadline()) {
+            close();
+            hand(guard, ready);
+            continue;
+        }
+        if (timers.empty() || now < timers.top().first) {
+            if (timers.empty() && !timed) {
+                condition.wait(guard);
+            } else {
+                Clock::time_point due = timers.empty() ? budget->getDeadline() : timers.top().first;
+                condition.wait_until(guard, timed ? std::min(due, budget->getDeadline()) : due);
+            }
+            continue;
+        }
+        std::string name = timers.top().second;
+        timers.pop();
+        Host& host = hostFor(name);
+        host.waiting = false;
+        release(name, host, ready);
+        hand(guard, ready);
+    }
+}
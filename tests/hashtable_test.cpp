@@ -0,0 +1,232 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <sstream>
+
+#include "../metrics.cpp"
+#include "../urlarena.cpp"
+#include "../hashtable.cpp"
+
+// Tests of the hash tables: the incremental migration of CoarseHashTable and StripedHashTable
+// (every element found while its stripe is half moved, cold stripes finished by the next resize),
+// and the same sets under concurrent inserts; LockFreeHashTable growing its segments while threads
+// insert into them and look them up
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static std::string urlOf(int i) {
+    return "http://host/page" + std::to_string(i);
+}
+
+// Access to the state of the migration
+template <class Table>
+struct Inspected : Table {
+    explicit Inspected(int capacity) : Table(capacity) {}
+
+    size_t tableCapacity() const {
+        return this->capacity;
+    }
+
+    size_t unmigratedStripes() const {
+        return this->stripesLeft;
+    }
+
+    size_t numStripes() const {
+        return this->migrated.size();
+    }
+};
+
+// Insert n URLs one at a time: each is new once, found at once, and so are all the previous ones
+// whatever the stage of the migration
+template <class Table>
+static void testSequential(const std::string& name, Table& table, int n) {
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        ok = ok && table.addURL(urlOf(i)) && !table.addURL(urlOf(i)) && table.containsURL(urlOf(i));
+        if (i % 97 == 0) {
+            for (int j = 0; j <= i; j += 13) {
+                ok = ok && table.containsURL(urlOf(j));
+            }
+        }
+    }
+    check(ok, name + ": every URL added once and found");
+    check(table.getSize() == n, name + ": size");
+    check(!table.containsURL(urlOf(n)), name + ": a URL never added is not found");
+}
+
+// URLs whose hash falls in stripe 0 only, so that no operation touches the other stripes: every
+// resize has to finish their migration itself
+template <class Table>
+static void testColdStripes(const std::string& name) {
+    Inspected<Table> table(8);
+    std::vector<std::string> hot;
+    for (int i = 0; hot.size() < 2000; i++) {
+        if (urlFingerprint(urlOf(i)) % table.numStripes() == 0) hot.push_back(urlOf(i));
+    }
+    std::vector<std::string> cold;
+    for (int i = 0; cold.size() < 100; i++) {
+        if (urlFingerprint(urlOf(-i - 1)) % table.numStripes() != 0) cold.push_back(urlOf(-i - 1));
+    }
+    for (const std::string& url : cold) {
+        table.addURL(url);
+    }
+    size_t resizes = 0;
+    size_t capacity = table.tableCapacity();
+    bool ok = true;
+    for (const std::string& url : hot) {
+        ok = ok && table.addURL(url);
+        if (table.tableCapacity() != capacity) {
+            resizes++;
+            capacity = table.tableCapacity();
+        }
+    }
+    check(ok, name + ": hot URLs added");
+    check(resizes >= 4 && table.getSize() / table.tableCapacity() <= 4,
+          name + ": the table keeps growing past cold stripes (capacity " + std::to_string(table.tableCapacity()) + ")");
+    check(table.unmigratedStripes() > 0, name + ": the cold stripes are still being migrated");
+    for (const std::string& url : cold) {
+        ok = ok && table.containsURL(url) && !table.addURL(url);
+    }
+    for (const std::string& url : hot) {
+        ok = ok && table.containsURL(url);
+    }
+    check(ok, name + ": every URL found after the resizes");
+    check(table.getSize() == (int) (hot.size() + cold.size()), name + ": size after the resizes");
+}
+
+// Threads adding overlapping ranges, one at a time and in batches: every URL is new for exactly one of them
+template <class Table>
+static void testConcurrent(const std::string& name, Table& table) {
+    const int numThreads = 8, n = 20000;
+    std::atomic<int> added(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&table, &added, t]() {
+            std::vector<std::string> batch;
+            for (int i = t * n / (2 * numThreads); i < n; i += 1 + t % 2) {
+                if (t % 4 < 2) {
+                    if (table.addURL(urlOf(i))) added++;
+                    continue;
+                }
+                batch.push_back(urlOf(i));
+                if (batch.size() == 50) {
+                    std::vector<std::string_view> views(batch.begin(), batch.end());
+                    for (bool b : table.addURLs(views)) {
+                        if (b) added++;
+                    }
+                    batch.clear();
+                }
+            }
+            std::vector<std::string_view> views(batch.begin(), batch.end());
+            for (bool b : table.addURLs(views)) {
+                if (b) added++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    check(added == n, name + ": every URL is new once (" + std::to_string(added) + ")");
+    check(table.getSize() == n, name + ": size");
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        ok = ok && table.containsURL(urlOf(i));
+    }
+    check(ok, name + ": every URL found");
+}
+
+static void testBaseHashTables() {
+    CoarseHashTable<std::string> coarse(8);
+    testSequential("coarse", coarse, 5000);
+    StripedHashTable<std::string> striped(8);
+    testSequential("striped", striped, 5000);
+    CoarseHashTable<int> integers(4);
+    bool ok = true;
+    for (int i = 0; i < 1000; i++) {
+        ok = ok && integers.addURL(i) && !integers.addURL(i);
+    }
+    for (int i = 0; i < 1000; i++) {
+        ok = ok && integers.containsURL(i);
+    }
+    check(ok && integers.getSize() == 1000 && !integers.containsURL(1000), "coarse of integers");
+
+    testColdStripes<StripedHashTable<std::string>>("striped cold stripes");
+
+    CoarseHashTable<std::string> coarseShared(8);
+    testConcurrent("coarse concurrent", coarseShared);
+    StripedHashTable<std::string> stripedShared(8);
+    testConcurrent("striped concurrent", stripedShared);
+}
+
+// Segments doubled again and again from 16 slots, under inserters which have to wait at the gate
+// of a segment being grown and readers which must keep finding every URL through the old slots
+static void testLockFree() {
+    LockFreeHashTable sequential(16);
+    testSequential("lock-free", sequential, 20000);
+    std::ostringstream out;
+    std::streambuf* previous = std::cout.rdbuf(out.rdbuf());
+    sequential.display();
+    std::cout.rdbuf(previous);
+    size_t lines = 0;
+    for (char c : out.str()) {
+        if (c == '\n') lines++;
+    }
+    check(lines == 20000, "lock-free: display lists every URL once");
+
+    LockFreeHashTable shared(16);
+    testConcurrent("lock-free concurrent", shared);
+
+    // The first inserter publishes how far it got, the readers look those URLs up meanwhile
+    LockFreeHashTable table(16);
+    const int n = 50000;
+    std::atomic<int> progress(0);
+    std::atomic<bool> missing(false);
+    std::vector<std::thread> threads;
+    threads.emplace_back([&table, &progress]() {
+        for (int i = 0; i < n; i++) {
+            table.addURL(urlOf(i));
+            progress.store(i + 1, std::memory_order_release);
+        }
+    });
+    for (int t = 1; t < 4; t++) {
+        threads.emplace_back([&table, t]() {
+            for (int i = n - 1 - t; i >= 0; i -= 3) {
+                table.addURL(urlOf(i));
+            }
+        });
+    }
+    for (int t = 0; t < 2; t++) {
+        threads.emplace_back([&table, &progress, &missing, t]() {
+            for (int round = 0; progress.load(std::memory_order_acquire) < n; round++) {
+                int known = progress.load(std::memory_order_acquire);
+                for (int i = t; i < known; i += 101) {
+                    if (!table.containsURL(urlOf(i))) missing = true;
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    check(!missing, "lock-free readers: every URL added is found while the segments grow");
+    check(table.getSize() == n, "lock-free readers: size");
+}
+
+int main() {
+    testBaseHashTables();
+    testLockFree();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "hashtable_test: OK" << std::endl;
+    return 0;
+}
@@ -0,0 +1,108 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../linkscanner.cpp"
+
+// Tests of LinkScanner: the links of a page, then the same page fed in chunks cut at every
+// position (tags, attribute values, comments and the end of a <script> split across chunks),
+// which must give the same links in the same order
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static const std::string PAGE =
+    "<!DOCTYPE html><html><head><base href=\"/base/\"><title>a < b</title>"
+    "<link rel=stylesheet href=style.css>"
+    "<style>a > b { content: '<a href=\"style\">'; }</style></head>"
+    "<body><!-- <a href=\"commented.html\"> --><a href=\"one.html\">One</a>"
+    "<A HREF='Two.html' class=\"x\">Two</A><a\nhref = three.html\n>Three</a>"
+    "<a name=anchor><a href=\"\">empty</a><a href=\"  spaced.html  \">"
+    "<script type=\"text/javascript\">var s = '<a href=\"script.html\">'; if (a<b) {}</script>"
+    "<img src=\"img.png\" srcset=\"small.png 1x, big.png 2x\"><a href=\"q.html?a=1&b=2#f\">"
+    "<a title=\"x > y\" href=\"quoted-gt.html\"></body></html>";
+
+static const std::vector<std::string> LINKS = {
+    "style.css", "one.html", "Two.html", "three.html", "spaced.html", "q.html?a=1&b=2#f", "quoted-gt.html"};
+
+static const std::vector<std::string> LINKS_WITH_SOURCES = {
+    "style.css", "one.html", "Two.html", "three.html", "spaced.html", "img.png", "small.png", "big.png",
+    "q.html?a=1&b=2#f", "quoted-gt.html"};
+
+static std::vector<std::string> scan(const std::string& html, bool withSources, std::string* base = nullptr) {
+    LinkScanner scanner(withSources);
+    std::vector<std::string> links;
+    scanner.scan(html.data(), html.size(), [&links](std::string_view link) { links.emplace_back(link); });
+    if (base) *base = scanner.baseHref();
+    return links;
+}
+
+// Feed html cut at the given positions (increasing)
+static std::vector<std::string> feed(const std::string& html, const std::vector<size_t>& cuts, std::string* base = nullptr) {
+    LinkScanner scanner;
+    std::vector<std::string> links;
+    size_t start = 0;
+    for (size_t i = 0; i <= cuts.size(); i++) {
+        size_t end = i < cuts.size() ? cuts[i] : html.size();
+        scanner.feed(html.data() + start, end - start, [&links](std::string_view link) { links.emplace_back(link); });
+        start = end;
+    }
+    if (base) *base = scanner.baseHref();
+    return links;
+}
+
+static void testWholePage() {
+    std::string base;
+    check(scan(PAGE, false, &base) == LINKS, "whole page: links");
+    check(base == "/base/", "whole page: base href");
+    check(scan(PAGE, true) == LINKS_WITH_SOURCES, "whole page: links with sources");
+    check(scan("<a href=\"cut.html", false).empty(), "truncated tag: dropped");
+}
+
+static void testChunks() {
+    for (size_t i = 0; i <= PAGE.size(); i++) {
+        std::string base;
+        std::vector<std::string> links = feed(PAGE, {i}, &base);
+        check(links == LINKS && base == "/base/", "2 chunks cut at " + std::to_string(i));
+    }
+    for (size_t i = 0; i <= PAGE.size(); i += 7) {
+        for (size_t j = i; j <= PAGE.size(); j += 5) {
+            check(feed(PAGE, {i, j}) == LINKS, "3 chunks cut at " + std::to_string(i) + " and " + std::to_string(j));
+        }
+    }
+    std::vector<size_t> everyByte;
+    for (size_t i = 1; i < PAGE.size(); i++) {
+        everyByte.push_back(i);
+    }
+    check(feed(PAGE, everyByte) == LINKS, "one byte per chunk");
+}
+
+// A tag longer than the scanner carries across chunks is skipped, the links after it are not
+static void testLongTag() {
+    std::string html = "<a href=\"before.html\"><a title=\"" + std::string(100 * 1024, 'x') + "\" href=\"long.html\">"
+        "<a href=\"after.html\">";
+    std::vector<size_t> cuts;
+    for (size_t i = 4096; i < html.size(); i += 4096) {
+        cuts.push_back(i);
+    }
+    check(feed(html, cuts) == std::vector<std::string>({"before.html", "after.html"}), "long tag: skipped");
+    check(scan(html, false) == std::vector<std::string>({"before.html", "long.html", "after.html"}),
+          "long tag: kept in a whole page");
+}
+
+int main() {
+    testWholePage();
+    testChunks();
+    testLongTag();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "linkscanner_test: OK" << std::endl;
+    return 0;
+}
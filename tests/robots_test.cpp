@@ -0,0 +1,105 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../metrics.cpp"
+#include "../fetcher.cpp"
+#include "../robots.cpp"
+
+// Tests of the robots.txt rules: the groups kept for the crawler's product token, and the paths the
+// trie and the wildcard patterns allow, longest match first
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+struct PathCase {
+    const char* path;
+    bool allowed;
+};
+
+static void checkPaths(const RobotsRules& rules, const std::string& name, const std::vector<PathCase>& cases) {
+    for (const PathCase& c : cases) {
+        check(rules.allowed(c.path) == c.allowed, name + ": " + c.path + (c.allowed ? " allowed" : " disallowed"));
+    }
+}
+
+// Only a group naming the whole product token, in any case, replaces the "*" group
+static void testGroupSelection() {
+    const std::string agent = "parallel-web-crawler";
+    checkPaths(RobotsRules::parse("User-agent: *\nDisallow: /all\n\nUser-agent: Parallel-Web-Crawler\nDisallow: /ours\n", agent),
+               "named", {{"/all", true}, {"/ours", false}});
+    checkPaths(RobotsRules::parse("User-agent: *\nDisallow: /all\n\nUser-agent: crawler\nUser-agent: web\nDisallow: /others\n", agent),
+               "substring", {{"/all", false}, {"/others", true}});
+    checkPaths(RobotsRules::parse("User-agent:\nDisallow: /empty\n\nUser-agent: *\nDisallow: /all\n", agent),
+               "empty agent", {{"/all", false}, {"/empty", true}});
+    checkPaths(RobotsRules::parse("User-agent: other\nUser-agent: PARALLEL-WEB-CRAWLER\nDisallow: /both\n\n"
+                                  "User-agent: parallel-web-crawler\nAllow: /both/open\nCrawl-delay: 2\n", agent),
+               "merged groups", {{"/both", false}, {"/both/open", true}, {"/", true}});
+    check(RobotsRules::parse("User-agent: parallel-web-crawler\nCrawl-delay: 1.5\n", agent).getCrawlDelay()
+          == std::chrono::milliseconds(1500), "crawl delay");
+    checkPaths(RobotsRules::parse("Disallow: /before\nUser-agent: *\nDisallow: /after # comment\n", agent),
+               "rules outside a group", {{"/before", true}, {"/after", false}});
+}
+
+// The longest pattern matching decides, Allow winning ties, whether plain (trie) or wildcard
+static void testMatching() {
+    RobotsRules rules = RobotsRules::parse(
+        "User-agent: *\n"
+        "Disallow: /private\n"
+        "Allow: /private/public\n"
+        "Disallow: /private/public/secret\n"
+        "Disallow: /tie\n"
+        "Allow: /tie\n"
+        "Disallow: /*.pdf$\n"
+        "Disallow: /search*q=\n"
+        "Allow: /search/help*\n"
+        "Disallow: /*/draft/\n"
+        "Allow: /docs/*/draft/ok\n", "parallel-web-crawler");
+    checkPaths(rules, "matching", {
+        {"/", true},
+        {"/privat", true},
+        {"/private", false},
+        {"/private.html", false},
+        {"/private/public", true},
+        {"/private/public/page", true},
+        {"/private/public/secret/x", false},
+        {"/tie", true},
+        {"/file.pdf", false},
+        {"/a/b/file.pdf", false},
+        {"/file.pdf?x=1", true},
+        {"/file.pdfx", true},
+        {"/search?q=x", false},
+        {"/search/sub?lang=en&q=x", false},
+        {"/search?lang=en", true},
+        {"/search/help?q=x", true},
+        {"/docs/v1/draft/", false},
+        {"/docs/v1/draft/ok", true},
+        {"/draft/", true},
+    });
+    checkPaths(RobotsRules::disallowAll(), "disallow all", {{"/", false}, {"/page", false}});
+    checkPaths(RobotsRules(), "no rules", {{"/", true}, {"/page", true}});
+}
+
+static void testPathOf() {
+    check(pathOf("http://host") == "/", "path of a bare host");
+    check(pathOf("http://host#frag") == "/", "path of a bare host with a fragment");
+    check(pathOf("http://host/a/b?q=1#frag") == "/a/b?q=1", "path with a query");
+    check(pathOf("https://host:8080?q") == "?q", "query without a path");
+}
+
+int main() {
+    testGroupSelection();
+    testMatching();
+    testPathOf();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "robots_test: OK" << std::endl;
+    return 0;
+}
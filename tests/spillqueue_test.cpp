@@ -0,0 +1,114 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "../frontier.cpp"
+#include "../scheduler.cpp"
+
+// Tests of SpillQueue losing its segment files: the queue must hand out what is left, in order,
+// report how many URLs were lost, then that it is empty instead of reading past its end.
+// The scheduler must count the lost URLs to its drop callback, so that the crawl still ends.
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+static std::string prefixFor(const std::string& name) {
+    return "/tmp/spillqueue-test-" + std::to_string(getpid()) + "-" + name + "-";
+}
+
+// Queue of n URLs "u0" to "u<n-1>" keeping window of them in memory
+static void fill(SpillQueue& queue, const std::string& prefix, size_t window, size_t n) {
+    queue.configure(prefix, window);
+    for (size_t i = 0; i < n; i++) {
+        queue.push_back(FrontierEntry{"u" + std::to_string(i), (uint32_t) i});
+    }
+}
+
+static std::vector<std::string> drain(SpillQueue& queue) {
+    std::vector<std::string> urls;
+    FrontierEntry entry;
+    while (queue.pop_front(entry)) {
+        urls.push_back(entry.url);
+    }
+    return urls;
+}
+
+// Every segment deleted, nothing buffered after them: only the URLs in memory come out
+static void testAllSegmentsLost() {
+    std::string prefix = prefixFor("all");
+    SpillQueue queue;
+    fill(queue, prefix, 4, 10); // 4 in memory, 3 segments of 2
+    for (int i = 0; i < 3; i++) {
+        check(std::remove((prefix + std::to_string(i)).c_str()) == 0, "segment " + std::to_string(i) + " spilled");
+    }
+    std::vector<std::string> urls = drain(queue);
+    check(urls == std::vector<std::string>({"u0", "u1", "u2", "u3"}), "all lost: the URLs in memory are kept");
+    check(queue.empty() && queue.size() == 0, "all lost: the queue is empty");
+    check(queue.takeLost() == 6, "all lost: the 6 URLs spilled are reported lost");
+    FrontierEntry entry;
+    check(!queue.pop_front(entry), "all lost: popping an empty queue fails");
+    check(queue.takeLost() == 0, "all lost: the loss is reported once");
+}
+
+// A segment in the middle deleted: the URLs before and after it come out in order
+static void testMiddleSegmentLost() {
+    std::string prefix = prefixFor("middle");
+    SpillQueue queue;
+    fill(queue, prefix, 4, 11); // 4 in memory, 3 segments of 2, 1 buffered
+    check(std::remove((prefix + "1").c_str()) == 0, "segment 1 spilled");
+    std::vector<std::string> urls = drain(queue);
+    check(urls == std::vector<std::string>({"u0", "u1", "u2", "u3", "u4", "u5", "u8", "u9", "u10"}),
+          "middle lost: the other URLs come out in order");
+    check(queue.empty() && queue.size() == 0, "middle lost: the queue is empty");
+    check(queue.takeLost() == 2, "middle lost: the 2 URLs of the segment are reported lost");
+}
+
+// A host queue loses its segments: every URL pushed is either dispatched or counted as dropped
+static void testSchedulerCountsLost() {
+    char dir[] = "/tmp/spillqueue-test-XXXXXX";
+    check(mkdtemp(dir) != nullptr, "scheduler: temporary directory");
+    std::vector<FrontierEntry> dispatched;
+    size_t dropped = 0;
+    {
+        // One transfer at a time so that the URLs pushed wait in the queue
+        HostScheduler scheduler(1, std::chrono::milliseconds(0), 0,
+                                [&dispatched](const FrontierEntry& e) { dispatched.push_back(e); },
+                                [&dropped](size_t count) { dropped += count; }, dir, 4);
+        for (int i = 0; i < 11; i++) {
+            scheduler.push("http://host/u" + std::to_string(i), 0);
+        }
+        // u0 is in flight, u1 to u4 in memory, u5 to u10 in 3 segments of 2
+        for (int i = 0; i < 3; i++) {
+            std::string file = std::string(dir) + "/frontier-" + std::to_string(getpid()) + "-1-" + std::to_string(i);
+            check(std::remove(file.c_str()) == 0, "scheduler: segment " + std::to_string(i) + " spilled");
+        }
+        for (size_t i = 0; i < dispatched.size(); i++) {
+            scheduler.done(dispatched[i].url);
+        }
+        check(scheduler.lost() == 6, "scheduler: the 6 URLs spilled are counted lost");
+        check(scheduler.size() == 0 && scheduler.dispatched() == 0, "scheduler: nothing is left");
+    }
+    check(dispatched.size() == 5, "scheduler: the 5 URLs in memory are dispatched");
+    check(dropped == 6, "scheduler: the lost URLs are counted to the drop callback");
+    rmdir(dir);
+}
+
+int main() {
+    testAllSegmentsLost();
+    testMiddleSegmentLost();
+    testSchedulerCountsLost();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "spillqueue_test: OK" << std::endl;
+    return 0;
+}
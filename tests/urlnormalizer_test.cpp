@@ -0,0 +1,162 @@
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "../linkscanner.cpp"
+#include "../urlnormalizer.cpp"
+
+// Tests of UrlNormalizer: the reference resolution examples of RFC 3986 (section 5.4), then the
+// normalization of percent-encodings, case, ports and queries. An expected URL "" means refused.
+static int failures = 0;
+
+static void check(bool condition, const std::string& what) {
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+struct Case {
+    const char* base;
+    const char* ref;
+    const char* expected;
+};
+
+static void checkCases(const std::string& name, bool keepQuery, const std::vector<Case>& cases) {
+    UrlNormalizer normalizer(keepQuery);
+    for (const Case& c : cases) {
+        bool resolved = normalizer.resolve(c.base, c.ref);
+        std::string got = resolved ? normalizer.url() : "";
+        check(got == c.expected, name + ": \"" + c.ref + "\" against \"" + c.base + "\" gives \"" + got
+              + "\" instead of \"" + c.expected + "\"");
+    }
+}
+
+// Section 5.4, with the query kept, the fragments being dropped and only http(s) URLs accepted
+static void testReferenceResolution() {
+    const char* base = "http://a/b/c/d;p?q";
+    checkCases("5.4.1", true, {
+        {base, "g:h", ""},
+        {base, "g", "http://a/b/c/g"},
+        {base, "./g", "http://a/b/c/g"},
+        {base, "g/", "http://a/b/c/g/"},
+        {base, "/g", "http://a/g"},
+        {base, "//g", "http://g/"},
+        {base, "?y", "http://a/b/c/d;p?y"},
+        {base, "g?y", "http://a/b/c/g?y"},
+        {base, "#s", "http://a/b/c/d;p?q"},
+        {base, "g#s", "http://a/b/c/g"},
+        {base, "g?y#s", "http://a/b/c/g?y"},
+        {base, ";x", "http://a/b/c/;x"},
+        {base, "g;x", "http://a/b/c/g;x"},
+        {base, "g;x?y#s", "http://a/b/c/g;x?y"},
+        {base, "", "http://a/b/c/d;p?q"},
+        {base, ".", "http://a/b/c/"},
+        {base, "./", "http://a/b/c/"},
+        {base, "..", "http://a/b/"},
+        {base, "../", "http://a/b/"},
+        {base, "../g", "http://a/b/g"},
+        {base, "../..", "http://a/"},
+        {base, "../../", "http://a/"},
+        {base, "../../g", "http://a/g"},
+    });
+    checkCases("5.4.2", true, {
+        {base, "../../../g", "http://a/g"},
+        {base, "../../../../g", "http://a/g"},
+        {base, "/./g", "http://a/g"},
+        {base, "/../g", "http://a/g"},
+        {base, "g.", "http://a/b/c/g."},
+        {base, ".g", "http://a/b/c/.g"},
+        {base, "g..", "http://a/b/c/g.."},
+        {base, "..g", "http://a/b/c/..g"},
+        {base, "./../g", "http://a/b/g"},
+        {base, "./g/.", "http://a/b/c/g/"},
+        {base, "g/./h", "http://a/b/c/g/h"},
+        {base, "g/../h", "http://a/b/c/h"},
+        {base, "g;x=1/./y", "http://a/b/c/g;x=1/y"},
+        {base, "g;x=1/../y", "http://a/b/c/y"},
+        {base, "g?y/./x", "http://a/b/c/g?y/./x"},
+        {base, "g?y/../x", "http://a/b/c/g?y/../x"},
+        {base, "g#s/./x", "http://a/b/c/g"},
+        {base, "g#s/../x", "http://a/b/c/g"},
+        {base, "http:g", ""}, // No host
+    });
+    checkCases("relative paths", false, {
+        {"http://host/dir/page.html", "a/b.html", "http://host/dir/a/b.html"},
+        {"http://host/dir/page.html", "../up.html", "http://host/up.html"},
+        {"http://host/dir/", "sub/", "http://host/dir/sub/"},
+        {"http://host", "page.html", "http://host/page.html"},
+        {"https://host/a/b", "//other/x", "https://other/x"},
+        {"http://host/a", "mailto:someone@host", ""},
+        {"http://host/a", "javascript:void(0)", ""},
+    });
+}
+
+static void testNormalization() {
+    checkCases("percent-encodings", false, {
+        {"", "http://host/%7euser", "http://host/~user"},
+        {"", "http://host/%7Euser/%41%2d", "http://host/~user/A-"},
+        {"", "http://host/a%2fb", "http://host/a%2Fb"},
+        {"", "http://host/a%2Fb%3a", "http://host/a%2Fb%3A"},
+        {"", "http://host/a b\"c", "http://host/a%20b%22c"},
+        {"", "http://host/100%", "http://host/100%25"},
+        {"", "http://host/%zz", "http://host/%25zz"},
+    });
+    checkCases("case and ports", false, {
+        {"", "HTTP://Example.COM/Path", "http://example.com/Path"},
+        {"", "http://host:80/a", "http://host/a"},
+        {"", "https://host:443/a", "https://host/a"},
+        {"", "http://host:443/a", "http://host:443/a"},
+        {"", "https://host:80/a", "https://host:80/a"},
+        {"", "http://host:0080/a", "http://host/a"},
+        {"", "http://host:/a", "http://host/a"},
+        {"", "http://host:8080", "http://host:8080/"},
+        {"", "http://host:8x/a", ""},
+        {"", "http://[::1]:80/a", "http://[::1]/a"},
+        {"", "http://[::1]/a", "http://[::1]/a"},
+        {"", "http:///a", ""},
+        {"", "ftp://host/a", ""},
+    });
+    checkCases("query stripped", false, {
+        {"", "http://host/a?x=1#f", "http://host/a"},
+        {"http://host/a?x=1", "", "http://host/a"},
+        {"http://host/a?x=1", "?y=2", "http://host/a"},
+        {"http://host/a", "b?y=2", "http://host/b"},
+    });
+    checkCases("query kept", true, {
+        {"", "http://host/a?x=1#f", "http://host/a?x=1"},
+        {"http://host/a?x=1", "", "http://host/a?x=1"},
+        {"http://host/a?x=1", "?y=2", "http://host/a?y=2"},
+        {"http://host/a", "b?y=%7e&z=a b", "http://host/b?y=~&z=a%20b"},
+        {"http://host/a", "b?", "http://host/b?"},
+    });
+
+    UrlNormalizer normalizer;
+    check(normalizer.normalize("https://Host:443/a?b") && normalizer.origin() == "https://host",
+          "origin without the default port");
+    check(normalizer.normalize("http://host:8080/a") && normalizer.origin() == "http://host:8080", "origin with a port");
+}
+
+// Links relative to the <base href> of their page once the scanner has seen it
+static void testPageLinks() {
+    PageLinks page("http://host/dir/page.html", false);
+    const std::string html = "<a href=\"a.html\"><base href=\"/other/\"><a href=\"b.html\"><a href=\"{id}.html\">";
+    std::vector<std::string> urls;
+    page.scanner.scan(html.data(), html.size(), [&page, &urls](std::string_view link) {
+        if (page.resolve(link)) urls.push_back(page.normalizer.url());
+    });
+    check(urls == std::vector<std::string>({"http://host/dir/a.html", "http://host/other/b.html"}),
+          "page links: resolved against the base href once seen, templates skipped");
+}
+
+int main() {
+    testReferenceResolution();
+    testNormalization();
+    testPageLinks();
+    if (failures > 0) {
+        std::cerr << failures << " checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "urlnormalizer_test: OK" << std::endl;
+    return 0;
+}
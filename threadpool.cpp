@@ -1,58 +1,171 @@
 #include <vector>
-#include <queue>
+#include <deque>
 #include <thread>
 #include <mutex>
+#include <atomic>
+#include <memory>
 #include <iostream>
 #include <condition_variable>
+#include <functional>
 
+// Work stealing thread pool
+// Every worker has its own deque: it pushes and pops the tasks it creates at the back (LIFO,
+// the freshest task is the hottest in cache), and idle workers steal from the front of the
+// others (FIFO, the oldest tasks). Tasks added from outside the pool are spread round robin.
+// The pool is idle once no task is queued, running or held, which is what wait_idle() waits for.
 class ThreadPool {
+    struct WorkQueue {
+        std::deque<std::function<void()>> tasks;
+        std::mutex lock;
+    };
+
     std::vector<std::thread> workers;
-    std::queue<std::function<void()>> tasks;
-    std::mutex queueMutex;
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::atomic<size_t> nextQueue;
+    // Tasks in the deques
+    std::atomic<size_t> queued;
+    // Queued and running tasks, plus work outside the pool which can still add tasks (e.g. fetches)
+    std::atomic<size_t> outstanding;
+    std::atomic<size_t> sleeping;
+    std::atomic<bool> stopping;
+    std::mutex sleepMutex;
     std::condition_variable condition;
+    std::mutex idleMutex;
+    std::condition_variable idleCondition;
+
+    // Worker of the calling thread, to push its tasks on its own deque
+    static thread_local ThreadPool* currentPool;
+    static thread_local size_t currentWorker;
 
-    void process_task_from_queue();
+    bool pop_local(size_t i, std::function<void()>& task);
+    bool steal(size_t i, std::function<void()>& task);
+    void finish_one();
+    void process_task_from_queue(size_t i);
 
 public:
     ThreadPool(size_t numThreads);
     ~ThreadPool();
     void add_task_to_queue(const std::function<void()>& task);
+    void hold();
+    void release_hold();
+    void wait_idle();
+    bool is_idle() const;
+    size_t queued_tasks() const;
 };
 
-ThreadPool::ThreadPool(size_t numThreads) {
+thread_local ThreadPool* ThreadPool::currentPool = nullptr;
+thread_local size_t ThreadPool::currentWorker = 0;
+
+ThreadPool::ThreadPool(size_t numThreads) : nextQueue(0), queued(0), outstanding(0), sleeping(0), stopping(false) {
     for (size_t i = 0; i < numThreads; ++i) {
-        workers.emplace_back(&ThreadPool::process_task_from_queue, this);
+        queues.emplace_back(new WorkQueue());
+    }
+    for (size_t i = 0; i < numThreads; ++i) {
+        workers.emplace_back(&ThreadPool::process_task_from_queue, this, i);
     }
 }
 
 ThreadPool::~ThreadPool() {
+    wait_idle();
+    {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        stopping = true;
+        condition.notify_all();
+    }
     for (std::thread& worker : workers) {
         worker.join();
     }
 }
 
 void ThreadPool::add_task_to_queue(const std::function<void()>& task) {
-    std::unique_lock<std::mutex> lock(queueMutex);
-    tasks.push(task);
-    condition.notify_one();
+    outstanding++;
+    size_t i = currentPool == this ? currentWorker : nextQueue++ % queues.size();
+    {
+        lockTimed(queues[i]->lock, POOL_LOCK_WAIT_NS);
+        std::unique_lock<std::mutex> lock(queues[i]->lock, std::adopt_lock);
+        queues[i]->tasks.push_back(task);
+        queued++;
+    }
+    if (sleeping > 0) {
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        condition.notify_one();
+    }
+}
+
+// Keep the pool busy until release_hold(), for work that will add tasks later
+void ThreadPool::hold() {
+    outstanding++;
+}
+
+void ThreadPool::release_hold() {
+    finish_one();
+}
+
+// Block until no task is queued, running or held
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(idleMutex);
+    idleCondition.wait(lock, [this]() { return outstanding == 0; });
 }
 
-void ThreadPool::process_task_from_queue() {
-    int i = 0;
+// Whether no task is queued, running or held right now
+bool ThreadPool::is_idle() const {
+    return outstanding == 0;
+}
+
+// Number of tasks waiting for a worker
+size_t ThreadPool::queued_tasks() const {
+    return queued;
+}
+
+void ThreadPool::finish_one() {
+    if (--outstanding == 0) {
+        std::unique_lock<std::mutex> lock(idleMutex);
+        idleCondition.notify_all();
+    }
+}
+
+bool ThreadPool::pop_local(size_t i, std::function<void()>& task) {
+    WorkQueue& queue = *queues[i];
+    lockTimed(queue.lock, POOL_LOCK_WAIT_NS);
+    std::unique_lock<std::mutex> lock(queue.lock, std::adopt_lock);
+    if (queue.tasks.empty()) return false;
+    task = std::move(queue.tasks.back());
+    queue.tasks.pop_back();
+    queued--;
+    return true;
+}
+
+bool ThreadPool::steal(size_t i, std::function<void()>& task) {
+    for (size_t k = 1; k < queues.size(); ++k) {
+        WorkQueue& victim = *queues[(i + k) % queues.size()];
+        lockTimed(victim.lock, POOL_LOCK_WAIT_NS);
+        std::unique_lock<std::mutex> lock(victim.lock, std::adopt_lock);
+        if (victim.tasks.empty()) continue;
+        task = std::move(victim.tasks.front());
+        victim.tasks.pop_front();
+        queued--;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::process_task_from_queue(size_t i) {
+    currentPool = this;
+    currentWorker = i;
     while (true) {
         std::function<void()> task;
-        {
-            std::unique_lock<std::mutex> lock(queueMutex);
-            if (i == 0){ // If at beginning, wait for tasks to arrive
-                condition.wait(lock, [this]() { return !tasks.empty(); });
-            } 
-            if (tasks.empty()) {
-                return;
-            } 
-            task = std::move(tasks.front());
-            tasks.pop();
+        if (pop_local(i, task) || steal(i, task)) {
+            task();
+            task = nullptr; // Release what the task holds before the pool can be seen idle
+            finish_one();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        sleeping++;
+        condition.wait(lock, [this]() { return queued > 0 || stopping; });
+        sleeping--;
+        if (stopping && queued == 0) {
+            return;
         }
-        task();
-        i++;
     }
-}
\ No newline at end of file
+}
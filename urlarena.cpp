@@ -0,0 +1,214 @@
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <new>
+#include <cstring>
+#include <cstdint>
+
+// FNV-1a over a piece of a URL, continuing from h
+inline uint64_t hashBytes(uint64_t h, std::string_view s) {
+    for (unsigned char c : s) {
+        h ^= c;
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+// murmur3 finalizer to mix the low bits, 0 is reserved to mark empty slots so it is never returned
+inline uint64_t finishHash(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h == 0 ? 1 : h;
+}
+
+// 64 bit fingerprint of a URL (FNV-1a followed by the murmur3 finalizer), never 0
+inline uint64_t urlFingerprint(std::string_view url) {
+    return finishHash(hashBytes(14695981039346656037ULL, url));
+}
+
+// Same fingerprint, of a URL given in two pieces
+inline uint64_t urlFingerprint(std::string_view prefix, std::string_view rest) {
+    return finishHash(hashBytes(hashBytes(14695981039346656037ULL, prefix), rest));
+}
+
+// URL arena
+// URLs are copied once into big chunks by a bump allocator and referred to by 32 bit handles (their
+// offset in 4 byte units), instead of one heap allocation per std::string. Their scheme and host, the
+// same for nearly all the URLs of a crawl, are stored once in a prefix table: a record is only the
+// index of its prefix (2 bytes), the length of the rest (varint) and the rest. Up to 16 GB of records.
+// Interning is thread safe: records are bumped off the current chunk with a CAS, and only a new chunk
+// or a new prefix takes the lock. Reading a handle received through a lock or an atomic is safe too.
+class UrlArena {
+private:
+    static const int UNIT_BITS = 2;
+    static const int CHUNK_BITS = 20;
+    static const size_t CHUNK_SIZE = (size_t) 1 << CHUNK_BITS;
+    static const size_t MAX_CHUNKS = (size_t) 1 << (32 + UNIT_BITS - CHUNK_BITS);
+    static const size_t MAX_PREFIXES = 1 << 16;
+
+    // Address of every chunk, a record longer than a chunk spans several consecutive ones
+    std::unique_ptr<std::atomic<char*>[]> chunks;
+    std::vector<std::unique_ptr<char[]>> blocks;
+    // Prefix 0 is empty, for URLs without a host or once the table is full
+    std::unique_ptr<std::atomic<const std::string*>[]> prefixes;
+    std::unordered_map<std::string, uint16_t> prefixIds;
+    size_t numPrefixes;
+    std::atomic<uint16_t> lastPrefix;
+    std::atomic<size_t> used; // Offset of the next record in bytes, starts at 1 unit so that no handle is 0
+    std::mutex lock;
+
+    // Length of the scheme and host of a URL, 0 if it has none
+    static size_t prefixLength(std::string_view url) {
+        size_t start = url.find("://");
+        if (start == std::string_view::npos) return 0;
+        size_t end = url.find_first_of("/?#", start + 3);
+        return end == std::string_view::npos ? url.size() : end;
+    }
+
+    uint16_t prefixFor(std::string_view prefix) {
+        uint16_t last = lastPrefix.load(std::memory_order_acquire);
+        if (*prefixes[last].load(std::memory_order_acquire) == prefix) return last;
+        std::lock_guard<std::mutex> guard(lock);
+        std::string key(prefix);
+        auto it = prefixIds.find(key);
+        uint16_t id = 0;
+        if (it != prefixIds.end()) {
+            id = it->second;
+        } else if (numPrefixes < MAX_PREFIXES) {
+            id = (uint16_t) numPrefixes++;
+            prefixes[id].store(new std::string(key), std::memory_order_release);
+            prefixIds.emplace(key, id);
+        }
+        lastPrefix.store(id, std::memory_order_release);
+        return id;
+    }
+
+    // Room for size bytes, taken from the current chunk if it has enough left
+    size_t allocate(size_t size) {
+        size_t rounded = (size + (1 << UNIT_BITS) - 1) & ~(size_t) ((1 << UNIT_BITS) - 1);
+        while (true) {
+            size_t offset = used.load(std::memory_order_acquire);
+            size_t chunk = offset >> CHUNK_BITS;
+            if (chunk < MAX_CHUNKS && chunks[chunk].load(std::memory_order_acquire)
+                && (offset & (CHUNK_SIZE - 1)) + size <= CHUNK_SIZE) {
+                if (used.compare_exchange_weak(offset, offset + rounded, std::memory_order_acq_rel)) return offset;
+                continue;
+            }
+            std::lock_guard<std::mutex> guard(lock);
+            offset = used.load(std::memory_order_acquire);
+            chunk = offset >> CHUNK_BITS;
+            if (chunk < MAX_CHUNKS && chunks[chunk].load(std::memory_order_relaxed)) {
+                if ((offset & (CHUNK_SIZE - 1)) + size > CHUNK_SIZE) {
+                    // Close the chunk, the next record starts a new one
+                    used.compare_exchange_strong(offset, (chunk + 1) << CHUNK_BITS, std::memory_order_acq_rel);
+                }
+                continue;
+            }
+            // The chunk has no memory yet, so nobody else can move used until it is published
+            size_t numChunks = ((offset & (CHUNK_SIZE - 1)) + size + CHUNK_SIZE - 1) >> CHUNK_BITS;
+            if (chunk + numChunks > MAX_CHUNKS) throw std::bad_alloc();
+            char* block = new char[numChunks << CHUNK_BITS];
+            blocks.emplace_back(block);
+            used.store(offset + rounded, std::memory_order_release);
+            for (size_t i = 0; i < numChunks; i++) {
+                chunks[chunk + i].store(block + (i << CHUNK_BITS), std::memory_order_release);
+            }
+            return offset;
+        }
+    }
+
+    void decode(uint32_t handle, std::string_view& prefix, std::string_view& rest) const {
+        size_t offset = (size_t) handle << UNIT_BITS;
+        const unsigned char* p = (const unsigned char*) chunks[offset >> CHUNK_BITS].load(std::memory_order_acquire)
+            + (offset & (CHUNK_SIZE - 1));
+        uint16_t id;
+        memcpy(&id, p, sizeof(id));
+        p += sizeof(id);
+        size_t length = 0;
+        for (int shift = 0; ; shift += 7) {
+            length |= (size_t) (*p & 0x7f) << shift;
+            if (!(*p++ & 0x80)) break;
+        }
+        prefix = *prefixes[id].load(std::memory_order_acquire);
+        rest = std::string_view((const char*) p, length);
+    }
+
+public:
+    UrlArena() : chunks(new std::atomic<char*>[MAX_CHUNKS]), prefixes(new std::atomic<const std::string*>[MAX_PREFIXES]),
+        numPrefixes(1), lastPrefix(0), used(1 << UNIT_BITS) {
+        for (size_t i = 0; i < MAX_CHUNKS; i++) {
+            chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+        prefixes[0].store(new std::string(), std::memory_order_relaxed);
+    }
+
+    UrlArena(const UrlArena&) = delete;
+    UrlArena& operator=(const UrlArena&) = delete;
+
+    ~UrlArena() {
+        for (size_t i = 0; i < numPrefixes; i++) {
+            delete prefixes[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Copy a URL into the arena, the handle is never 0
+    uint32_t intern(std::string_view url) {
+        size_t split = prefixLength(url);
+        uint16_t id = split > 0 ? prefixFor(url.substr(0, split)) : 0;
+        std::string_view rest = id > 0 ? url.substr(split) : url;
+        unsigned char header[sizeof(id) + 10];
+        size_t headerSize = sizeof(id);
+        memcpy(header, &id, sizeof(id));
+        for (size_t length = rest.size(); ; length >>= 7) {
+            header[headerSize++] = (unsigned char) ((length & 0x7f) | (length >= 0x80 ? 0x80 : 0));
+            if (length < 0x80) break;
+        }
+        size_t offset = allocate(headerSize + rest.size());
+        char* p = chunks[offset >> CHUNK_BITS].load(std::memory_order_acquire) + (offset & (CHUNK_SIZE - 1));
+        memcpy(p, header, headerSize);
+        memcpy(p + headerSize, rest.data(), rest.size());
+        return (uint32_t) (offset >> UNIT_BITS);
+    }
+
+    // Whether handle holds url, without rebuilding it
+    bool equals(uint32_t handle, std::string_view url) const {
+        std::string_view prefix, rest;
+        decode(handle, prefix, rest);
+        return url.size() == prefix.size() + rest.size()
+            && url.compare(0, prefix.size(), prefix) == 0
+            && url.compare(prefix.size(), rest.size(), rest) == 0;
+    }
+
+    std::string get(uint32_t handle) const {
+        std::string_view prefix, rest;
+        decode(handle, prefix, rest);
+        std::string url;
+        url.reserve(prefix.size() + rest.size());
+        url.append(prefix).append(rest);
+        return url;
+    }
+
+    // urlFingerprint of the URL of handle
+    uint64_t fingerprint(uint32_t handle) const {
+        std::string_view prefix, rest;
+        decode(handle, prefix, rest);
+        return urlFingerprint(prefix, rest);
+    }
+
+    // Forget all the URLs (not safe against concurrent use), the prefixes are kept
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock);
+        for (size_t i = 0; i < MAX_CHUNKS; i++) {
+            chunks[i].store(nullptr, std::memory_order_relaxed);
+        }
+        blocks.clear();
+        used.store(1 << UNIT_BITS, std::memory_order_relaxed);
+    }
+};
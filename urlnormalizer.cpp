@@ -0,0 +1,256 @@
+#include <string>
+#include <string_view>
+#include <cstring>
+
+// RFC 3986 URL normalizer (https://www.rfc-editor.org/rfc/rfc3986)
+// Resolves a reference found on a page against the page URL (section 5.2, dot segments included)
+// and writes the canonical form into one buffer reused from call to call: lowercase scheme and host,
+// no default port, "/" for an empty path, uppercase percent-encodings, unreserved characters decoded
+// and invalid ones encoded, no fragment, and no query unless keepQuery. The pieces of the URLs are
+// only looked at through string_views, so nothing is allocated once the buffer has grown.
+// Only http and https URLs are accepted.
+class UrlNormalizer {
+private:
+    struct Parts {
+        std::string_view scheme, authority, path, query;
+        bool hasScheme = false, hasAuthority = false, hasQuery = false;
+    };
+
+    bool keepQuery;
+    std::string buffer;
+    size_t originLength;
+
+    static bool isAlpha(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+    }
+
+    static bool isDigit(char c) {
+        return c >= '0' && c <= '9';
+    }
+
+    static int hexValue(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    static bool isUnreserved(unsigned char c) {
+        return isAlpha(c) || isDigit(c) || c == '-' || c == '.' || c == '_' || c == '~';
+    }
+
+    // Characters left as they are in a path (pchar and '/'), plus extra ("?" in a query, "[]" in a host)
+    static bool isAllowed(unsigned char c, const char* extra) {
+        return isUnreserved(c) || (c && (strchr("!$&'()*+,;=:@/", c) || strchr(extra, c)));
+    }
+
+    static char lower(char c) {
+        return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+    }
+
+    void appendEncoded(unsigned char c) {
+        static const char digits[] = "0123456789ABCDEF";
+        buffer.push_back('%');
+        buffer.push_back(digits[c >> 4]);
+        buffer.push_back(digits[c & 15]);
+    }
+
+    // Append s with its percent-encodings normalized
+    void appendNormalized(std::string_view s, const char* extra) {
+        for (size_t i = 0; i < s.size(); i++) {
+            unsigned char c = s[i];
+            if (c == '%' && i + 2 < s.size() && hexValue(s[i + 1]) >= 0 && hexValue(s[i + 2]) >= 0) {
+                unsigned char decoded = (unsigned char) (hexValue(s[i + 1]) * 16 + hexValue(s[i + 2]));
+                if (isUnreserved(decoded)) buffer.push_back((char) decoded);
+                else appendEncoded(decoded);
+                i += 2;
+            } else if (isAllowed(c, extra)) {
+                buffer.push_back((char) c);
+            } else {
+                appendEncoded(c);
+            }
+        }
+    }
+
+    // Split a reference into its components (appendix B), the fragment is dropped
+    static Parts split(std::string_view ref) {
+        Parts parts;
+        size_t hash = ref.find('#');
+        if (hash != std::string_view::npos) ref = ref.substr(0, hash);
+        size_t i = 0;
+        if (!ref.empty() && isAlpha(ref[0])) {
+            while (i < ref.size() && (isAlpha(ref[i]) || isDigit(ref[i]) || ref[i] == '+' || ref[i] == '-' || ref[i] == '.')) i++;
+            if (i < ref.size() && ref[i] == ':') {
+                parts.scheme = ref.substr(0, i);
+                parts.hasScheme = true;
+                ref.remove_prefix(i + 1);
+            }
+        }
+        if (ref.size() >= 2 && ref[0] == '/' && ref[1] == '/') {
+            size_t end = ref.find_first_of("/?", 2);
+            if (end == std::string_view::npos) end = ref.size();
+            parts.authority = ref.substr(2, end - 2);
+            parts.hasAuthority = true;
+            ref.remove_prefix(end);
+        }
+        size_t question = ref.find('?');
+        if (question != std::string_view::npos) {
+            parts.query = ref.substr(question + 1);
+            parts.hasQuery = true;
+            ref = ref.substr(0, question);
+        }
+        parts.path = ref;
+        return parts;
+    }
+
+    static bool equalsLower(std::string_view s, std::string_view lowerCase) {
+        if (s.size() != lowerCase.size()) return false;
+        for (size_t i = 0; i < s.size(); i++) {
+            if (lower(s[i]) != lowerCase[i]) return false;
+        }
+        return true;
+    }
+
+    // Append scheme://authority, false if the URL is not http(s) or has no host
+    bool appendOrigin(std::string_view scheme, std::string_view authority) {
+        bool https = equalsLower(scheme, "https");
+        if (!https && !equalsLower(scheme, "http")) return false;
+        buffer.append(https ? "https://" : "http://");
+        size_t at = authority.rfind('@');
+        if (at != std::string_view::npos) {
+            appendNormalized(authority.substr(0, at + 1), "");
+            authority.remove_prefix(at + 1);
+        }
+        // The port follows the last ':' which is not inside an IPv6 literal
+        size_t colon = authority.rfind(':');
+        if (colon != std::string_view::npos && authority.find(']', colon) != std::string_view::npos) {
+            colon = std::string_view::npos;
+        }
+        std::string_view host = authority.substr(0, colon);
+        std::string_view port = colon == std::string_view::npos ? std::string_view() : authority.substr(colon + 1);
+        if (host.empty()) return false;
+        size_t hostStart = buffer.size();
+        appendNormalized(host, "[]");
+        for (size_t i = hostStart; i < buffer.size(); i++) {
+            if (buffer[i] == '%') i += 2; // Keep the percent-encodings uppercase
+            else buffer[i] = lower(buffer[i]);
+        }
+        for (char c : port) {
+            if (!isDigit(c)) return false;
+        }
+        while (port.size() > 1 && port[0] == '0') port.remove_prefix(1);
+        if (!port.empty() && port != (https ? "443" : "80")) {
+            buffer.push_back(':');
+            buffer.append(port);
+        }
+        return true;
+    }
+
+    // Append the segments of path to the path being written from pathStart ("/seg" each),
+    // removing the dot segments (5.2.4). last tells if these are the final segments of the path.
+    void appendSegments(std::string_view path, size_t pathStart, bool last) {
+        if (path.empty()) return;
+        if (path[0] == '/') path.remove_prefix(1);
+        while (true) {
+            size_t slash = path.find('/');
+            std::string_view segment = path.substr(0, slash);
+            bool final = last && slash == std::string_view::npos;
+            if (segment == "..") {
+                size_t previous = buffer.rfind('/');
+                buffer.resize(previous == std::string::npos || previous < pathStart ? pathStart : previous);
+            }
+            if (segment == "." || segment == "..") {
+                if (final) buffer.push_back('/');
+            } else {
+                buffer.push_back('/');
+                appendNormalized(segment, "");
+            }
+            if (slash == std::string_view::npos) break;
+            path.remove_prefix(slash + 1);
+        }
+    }
+
+    void appendQuery(std::string_view query) {
+        if (!keepQuery) return;
+        buffer.push_back('?');
+        appendNormalized(query, "?");
+    }
+
+public:
+    explicit UrlNormalizer(bool keepQuery = false) : keepQuery(keepQuery), originLength(0) {}
+
+    // Resolve ref against the absolute URL base and normalize it, false if it is not an http(s) URL
+    bool resolve(std::string_view base, std::string_view ref) {
+        buffer.clear();
+        Parts r = split(ref);
+        Parts b;
+        if (!r.hasScheme) {
+            b = split(base);
+            if (!b.hasScheme || !b.hasAuthority) return false;
+        }
+        std::string_view scheme = r.hasScheme ? r.scheme : b.scheme;
+        std::string_view authority = r.hasScheme || r.hasAuthority ? r.authority : b.authority;
+        if (!appendOrigin(scheme, authority)) return false;
+        originLength = buffer.size();
+
+        size_t pathStart = buffer.size();
+        if (r.hasScheme || r.hasAuthority || (!r.path.empty() && r.path[0] == '/')) {
+            appendSegments(r.path, pathStart, true);
+            if (r.hasQuery) appendQuery(r.query);
+        } else if (r.path.empty()) {
+            appendSegments(b.path, pathStart, true);
+            if (r.hasQuery) appendQuery(r.query);
+            else if (b.hasQuery) appendQuery(b.query);
+        } else {
+            // Merge: the directory of the base path followed by the reference
+            size_t slash = b.path.rfind('/');
+            if (slash != std::string_view::npos) appendSegments(b.path.substr(0, slash), pathStart, false);
+            appendSegments(r.path, pathStart, true);
+            if (r.hasQuery) appendQuery(r.query);
+        }
+        if (buffer.size() == pathStart || buffer[pathStart] != '/') {
+            buffer.insert(pathStart, 1, '/');
+        }
+        return true;
+    }
+
+    // Normalize an absolute URL
+    bool normalize(std::string_view url) {
+        return resolve(std::string_view(), url);
+    }
+
+    // The last URL resolved
+    const std::string& url() const {
+        return buffer;
+    }
+
+    // Its scheme and authority ("https://host:port")
+    std::string_view origin() const {
+        return std::string_view(buffer).substr(0, originLength);
+    }
+};
+
+// Links of one page (needs linkscanner.cpp): the scanner and normalizer of the page, and the URL
+// its links are relative to, which is the page URL or its <base href> once the scanner has seen it
+struct PageLinks {
+    std::string url;
+    LinkScanner scanner;
+    UrlNormalizer normalizer;
+    std::string base;
+
+    PageLinks(const std::string& url, bool keepQuery) : url(url), normalizer(keepQuery) {}
+
+    const std::string& baseURL() {
+        if (base.empty() && !scanner.baseHref().empty()) {
+            base = normalizer.resolve(url, scanner.baseHref()) ? normalizer.url() : url;
+        }
+        return base.empty() ? url : base;
+    }
+
+    // Resolve a link of the page into normalizer.url(), false if it is not an http(s) link
+    // Links with '{' are template placeholders rather than links
+    bool resolve(std::string_view link) {
+        if (link.find('{') != std::string_view::npos) return false;
+        return normalizer.resolve(baseURL(), link);
+    }
+};
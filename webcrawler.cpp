@@ -1,123 +1,157 @@
 #include <iostream>
 #include <string>
-#include <regex>
+#include <string_view>
 #include <vector>
 #include <curl/curl.h>
 #include <chrono>
+#include <thread>
+#include "metrics.cpp"
+#include "urlarena.cpp"
 #include "hashtable.cpp"
+#include "contentdedup.cpp"
+#include "linkscanner.cpp"
+#include "urlnormalizer.cpp"
+#include "fetcher.cpp"
+#include "frontier.cpp"
+#include "robots.cpp"
+#include "resultsink.cpp"
+#include "pagecache.cpp"
 
-// Callback function to receive HTTP response
-size_t writeCallback(char* ptr, size_t size, size_t nmemb, std::string* data) {
-    data->append(ptr, size * nmemb);
-    return size * nmemb;
-}
-
-// Function to check if URL exists
-bool urlExists(const std::string& url) {
-    CURL* curl;
-    CURLcode res;
-    long response_code = 0;
+// Settings of a serial crawl
+struct SerialCrawl {
+    std::string base_url;
+    const RobotsRules* robots; // Rules of the site, nullptr to ignore its robots.txt
+    bool keepQuery;
+    ResultSink* sink;    // Gets a record of every page once its links are crawled, nullptr for none
+    ContentDedup* dedup; // Skips the links of the pages with the content of a page seen, nullptr to follow them all
+    PageCache* cache;    // Pages of the previous crawl, nullptr to fetch every page in full
+    CrawlBudget* budget; // Limits of the crawl, nullptr for none
+    FrontierScore order; // Of the frontier, nullptr for FIFO (breadth first)
+};
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L); // We don't need the body
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); // Follow redirects
-
-        res = curl_easy_perform(curl);
-        
-        if(res == CURLE_OK) {
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            if(response_code == 200) {
-                curl_easy_cleanup(curl);
-                curl_global_cleanup();
-                return true;
-            }
-        }
-        curl_easy_cleanup(curl);
+// Function to extract URLs from crawling the HTML content of the page of entry, and queue the new ones in frontier
+// With a page cache, the request is conditional and the links of an unchanged page are taken from the cache
+template <class T>
+void crawl_page(const FrontierEntry& entry, T &urlSet, PriorityFrontier& frontier, const SerialCrawl& settings) {
+    const std::string& url = entry.url;
+    uint32_t depth = entry.depth;
+    const RobotsRules* robots = settings.robots;
+    if (robots && robots->getCrawlDelay().count() > 0) {
+        std::this_thread::sleep_for(robots->getCrawlDelay());
     }
-    curl_global_cleanup();
-    return false;
-}
-
-// Function to fetch HTML content from a URL
-std::string fetchHTML(const std::string& url) {
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        std::string data;
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); // Follow redirects
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            // std::cerr << "Failed to fetch URL: " << curl_easy_strerror(res) << std::endl;
-            return ""; // Return empty string to indicate failure
+    FetchResult result;
+    std::string html = fetchPage(url, result, settings.cache ? settings.cache->validators(url) : Validators());
+    std::vector<std::string> outlinks;
+    std::vector<std::string> cached;
+    uint64_t hash = settings.cache && !html.empty() ? ContentDedup::contentHash(html) : 0;
+    bool unchanged = false;
+    if (html.empty() && !(settings.cache && result.status == 304)) {
+        if (settings.sink) settings.sink->record(url, result, depth, outlinks);
+        return;
+    }
+    if (settings.dedup && !html.empty() && settings.dedup->duplicate(html)) {
+        metrics.add(DUPLICATE_PAGES);
+        if (settings.sink) settings.sink->record(url, result, depth, outlinks);
+        return;
+    }
+    if (settings.cache && settings.cache->unchanged(url, result, hash, cached)) {
+        metrics.add(UNCHANGED_PAGES);
+        unchanged = true;
+    }
+    PageLinks page(url, settings.keepQuery);
+    auto visit = [&](std::string_view link) {
+        metrics.add(LINKS_FOUND);
+        if (!page.resolve(link)) {
+            return;
+        }
+        // To ensure that the URL is on the site of the base URL
+        if (page.normalizer.origin() != settings.base_url) {
+            return;
+        }
+        const std::string& url2 = page.normalizer.url();
+        if (settings.sink || settings.cache) outlinks.push_back(url2);
+        if (robots && !robots->allowed(pathOf(url2))) {
+            return;
+        }
+        if (settings.budget && !settings.budget->allowsDepth(depth + 1)) {
+            return;
+        }
+        if (!urlSet.addURL(url2)){
+            return;
+        }
+        metrics.add(URLS_ADDED);
+        frontier.push_back(FrontierEntry{url2, depth + 1});
+    };
+    if (unchanged) {
+        for (const std::string& link : cached) {
+            visit(link);
         }
-        curl_easy_cleanup(curl);
-        return data;
     } else {
-        std::cerr << "Failed to initialize CURL" << std::endl;
-        return "";
+        page.scanner.scan(html.data(), html.size(), visit);
+        if (settings.cache && result.status >= 200 && result.status < 300) {
+            settings.cache->update(url, result, hash, outlinks);
+        }
     }
+    if (settings.sink) settings.sink->record(url, result, depth, outlinks);
 }
 
-// Function to extract URLs from crawling the HTML content using regex
+// Crawl from url, fetching the URLs found best first (see PriorityFrontier) until none is left or the budget is exhausted
+// URLs are added to the set when they are found, so each is queued once.
 template <class T>
-void crawl(std::string &url, const std::string &base_url, T &urlSet) {
-    std::string html = fetchHTML(url);
-    if (html.empty()) {
-        return;
-    }
+void crawl(const std::string& url, T& urlSet, const SerialCrawl& settings) {
+    PriorityFrontier frontier(settings.order);
     urlSet.addURL(url);
-    // Regular expression to find URLs in HTML
-    std::regex urlRegex(R"(href=["']([^"']+)["'])");
-    auto words_begin = std::sregex_iterator(html.begin(), html.end(), urlRegex);
-    auto words_end = std::sregex_iterator();
-    for (std::sregex_iterator i = words_begin; i != words_end; ++i) {
-        std::smatch match = *i;
-        std::string url2 = match[1].str();
-
-        // To ensure that the URL starts with the base URL
-        if (url2.find(base_url) != 0) {
-            if (url2.find('#') != std::string::npos 
-                || url2.find("//") != std::string::npos 
-                || url2.find(":") != std::string::npos 
-                || url2.find("{") != std::string::npos){
-                continue; // Pass if the url is an id on the page (#), another protocol (// or :) or a script ({)
-            }else if (url2.find('/') == 0) { // Relative url 
-                url2 = base_url + url2;
-            } else if (url2.find('/') == std::string::npos){ // relative url
-                url2 = base_url + '/' + url2;
-            } else {
-                continue;
-            }
-        }
-        if (url2.find('#') != std::string::npos){ // Remove ids on page
-            url2 = url2.substr(0, url2.find("#"));
-        }
-        if (url2.find('?') != std::string::npos){  // Remove argumnets on page
-            url2 = url2.substr(0, url2.find("?"));
-        }
-        if (urlSet.containsURL(url2)){
-            continue;
+    metrics.add(URLS_ADDED);
+    frontier.push_back(FrontierEntry{url, 0});
+    while (!frontier.empty()) {
+        if (settings.budget && !settings.budget->takePage()) {
+            std::cout << "Crawl budget exhausted, " << frontier.size() << " URLs were not fetched" << std::endl;
+            return;
         }
+        crawl_page(frontier.pop_front(), urlSet, frontier, settings);
+    }
+}
 
-        crawl(url2, base_url, urlSet);
+// Save the page cache and display the URLs found, unless they were streamed to the sink
+template <class T>
+void finish(T& urlSet, const SerialCrawl& settings) {
+    if (settings.cache) settings.cache->save();
+    if (!settings.sink) {
+        std::cout << "URLs found" << std::endl;
+        urlSet.display();
     }
+    std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
 }
 
 int main(int argc, char* argv[]) {
 
-    if (argc != 3){
+    if (argc < 3){
         std::cerr << "Invalid command, please give your command as:" << std::endl;
-        std::cerr << "./webcrawler <opt_set> <url>" << std::endl;
-        std::cerr << "opt_set being 0 (SetList), 1 (CoarsedHashTable), or 2 (StripedHashTable)" << std::endl;
-        std::cerr << "\t\t defining the set you want to use to store the urls" << std::endl;
+        std::cerr << "./webcrawler <opt_set> <url> [options]" << std::endl;
+        std::cerr << "opt_set being 0 (SetList), 1 (CoarsedHashTable), 2 (StripedHashTable), 3 (LockFreeHashTable)" << std::endl;
+        std::cerr << "\t\t or 4 (MappedFingerprintSet) defining the set you want to use to store the urls" << std::endl;
         std::cerr << "url being the url you want to crawl" << std::endl;
+        std::cerr << "options being any of:" << std::endl;
+        std::cerr << "\t--fetch-latency\t\t print the median and 99th percentile of the fetch durations" << std::endl;
+        std::cerr << "\t--max-page-size <bytes>\t abandon the pages larger than bytes (default 10 MB, 0 for no limit)" << std::endl;
+        std::cerr << "\t--all-content-types\t download the pages whatever their Content-Type, not only HTML" << std::endl;
+        std::cerr << "\t--http2\t\t\t negotiate HTTP/2 with the server" << std::endl;
+        std::cerr << "\t--ignore-robots\t\t do not fetch nor respect the robots.txt of the site" << std::endl;
+        std::cerr << "\t--spill-dir <dir>\t directory of the files of the set 4 (default /tmp)" << std::endl;
+        std::cerr << "\t--expected-urls <n>\t size the table of the set 4 for n URLs" << std::endl;
+        std::cerr << "\t--visited-memory <MB>\t keep at most about MB of the table of the set 4 in memory (default no limit)" << std::endl;
+        std::cerr << "\t--keep-query\t\t keep the query of the URLs instead of removing it" << std::endl;
+        std::cerr << "\t--metrics <s>\t\t print the metrics of the crawl on stderr every s seconds" << std::endl;
+        std::cerr << "\t--metrics-file <file>\t write the metrics in the Prometheus text format to file" << std::endl;
+        std::cerr << "\t--output <file>\t\t stream a record of every page to file instead of displaying the URLs at the end" << std::endl;
+        std::cerr << "\t--output-format <f>\t format of the records, jsonl (default) or binary" << std::endl;
+        std::cerr << "\t--cache <file>\t\t recrawl incrementally: fetch the pages of the previous crawl recorded in file only if they changed" << std::endl;
+        std::cerr << "\t--max-depth <n>\t\t do not crawl the URLs more than n links away from the seed" << std::endl;
+        std::cerr << "\t--max-pages <n>\t\t stop fetching after n pages" << std::endl;
+        std::cerr << "\t--time-limit <s>\t stop fetching after s seconds" << std::endl;
+        std::cerr << "\t--order <o>\t\t order of the frontier: fifo (default, breadth first), depth or url-length (shortest first)" << std::endl;
+        std::cerr << "\t--dedup-content\t\t do not follow the links of pages with the same content as a page seen" << std::endl;
+        std::cerr << "\t--simhash-distance <k>\t with --dedup-content, pages within k bits of SimHash are the same (default 3, 0 to 7)" << std::endl;
         return 1;
     }
 
@@ -125,53 +159,170 @@ int main(int argc, char* argv[]) {
 
     int option_urlset = std::stoi(argv[1]);
     std::string url = argv[2];
+    bool ignore_robots = false;
+    std::string spill_dir = "/tmp";
+    int expected_urls = 1024;
+    int visited_memory = 0;
+    bool keep_query = false;
+    int metrics_interval = 0;
+    std::string metrics_file;
+    std::string output;
+    ResultSink::Format output_format = ResultSink::JSONL;
+    bool dedup_content = false;
+    int simhash_distance = 3;
+    std::string cache_file;
+    long max_depth = -1;
+    size_t max_pages = 0;
+    int time_limit = 0;
+    FrontierScore order = nullptr;
+    for (int i = 3; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--fetch-latency") {
+            fetchConfig.latencies = true;
+        } else if (option == "--max-page-size" && i + 1 < argc) {
+            fetchConfig.maxBytes = std::stoll(argv[++i]);
+        } else if (option == "--all-content-types") {
+            fetchConfig.htmlOnly = false;
+        } else if (option == "--http2") {
+            fetchConfig.http2 = true;
+        } else if (option == "--ignore-robots") {
+            ignore_robots = true;
+        } else if (option == "--spill-dir" && i + 1 < argc) {
+            spill_dir = argv[++i];
+        } else if (option == "--expected-urls" && i + 1 < argc) {
+            expected_urls = std::stoi(argv[++i]);
+        } else if (option == "--visited-memory" && i + 1 < argc) {
+            visited_memory = std::stoi(argv[++i]);
+        } else if (option == "--keep-query") {
+            keep_query = true;
+        } else if (option == "--metrics" && i + 1 < argc) {
+            metrics_interval = std::stoi(argv[++i]);
+        } else if (option == "--metrics-file" && i + 1 < argc) {
+            metrics_file = argv[++i];
+        } else if (option == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (option == "--output-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "jsonl") {
+                output_format = ResultSink::JSONL;
+            } else if (format == "binary") {
+                output_format = ResultSink::BINARY;
+            } else {
+                std::cerr << "Unknown output format " << format << ", please use jsonl or binary" << std::endl;
+                return 1;
+            }
+        } else if (option == "--cache" && i + 1 < argc) {
+            cache_file = argv[++i];
+        } else if (option == "--max-depth" && i + 1 < argc) {
+            max_depth = std::stol(argv[++i]);
+        } else if (option == "--max-pages" && i + 1 < argc) {
+            max_pages = std::stoul(argv[++i]);
+        } else if (option == "--time-limit" && i + 1 < argc) {
+            time_limit = std::stoi(argv[++i]);
+        } else if (option == "--order" && i + 1 < argc) {
+            std::string name = argv[++i];
+            if (!parseCrawlOrder(name, order)) {
+                std::cerr << "Unknown order " << name << ", please use fifo, depth or url-length" << std::endl;
+                return 1;
+            }
+        } else if (option == "--dedup-content") {
+            dedup_content = true;
+        } else if (option == "--simhash-distance" && i + 1 < argc) {
+            simhash_distance = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
+
+    if (simhash_distance < 0 || simhash_distance > 7) {
+        std::cerr << "The SimHash distance must be between 0 and 7" << std::endl;
+        return 1;
+    }
 
     // Keep only url starting like first one in order to avoid crawling the whole internet (ex. redirects to instagram.com ...)!
-    std::regex baseUrlRegex(R"((https?://[^/]+))");
-    std::smatch baseUrlMatch;
-    std::string base_url;
-    if (std::regex_search(url, baseUrlMatch, baseUrlRegex)) {
-        base_url = baseUrlMatch[1].str();
-    } else {
-        std::cerr << "Failed to extract base URL." << std::endl;
+    UrlNormalizer normalizer(keep_query);
+    if (!normalizer.normalize(url)) {
+        std::cerr << "Invalid URL format. Please enter a valid URL starting with http:// or https://" << std::endl;
         return 1;
     }
+    url = normalizer.url();
+    std::string base_url(normalizer.origin());
     std::cout << "Base URL: " << base_url << std::endl;
 
-    // Validate the URL format
-    std::regex urlFormat(R"(https?://\S+)");
-    if (!std::regex_match(url, urlFormat)) {
-        // std::cerr << "Invalid URL format. Please enter a valid URL starting with http:// or https://" << std::endl;
-        return 1;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    std::unique_ptr<MetricsReporter> reporter;
+    if (metrics_interval > 0 || !metrics_file.empty()) {
+        reporter.reset(new MetricsReporter(std::chrono::seconds(metrics_interval > 0 ? metrics_interval : 5),
+                                           metrics_interval > 0, metrics_file));
+        reporter->start();
     }
 
+    RobotsCache robotsCache(ROBOTS_AGENT);
+    const RobotsRules* robots = nullptr;
+    if (!ignore_robots) {
+        robots = &robotsCache.rulesFor(base_url);
+        if (!robots->allowed(pathOf(url))) {
+            std::cerr << "URL disallowed by robots.txt: " << url << std::endl;
+            return 1;
+        }
+    }
+
+    std::unique_ptr<ResultSink> sink;
+    if (!output.empty()) {
+        sink.reset(new ResultSink(output, output_format, std::chrono::seconds(1), false));
+        if (!sink->isOpen()) return 1;
+    }
+    std::unique_ptr<ContentDedup> dedup;
+    if (dedup_content) {
+        dedup.reset(new ContentDedup(simhash_distance));
+    }
+    std::unique_ptr<PageCache> cache;
+    if (!cache_file.empty()) {
+        cache.reset(new PageCache(cache_file));
+        if (!cache->load()) return 1;
+    }
+    std::unique_ptr<CrawlBudget> budget;
+    if (max_depth >= 0 || max_pages > 0 || time_limit > 0) {
+        budget.reset(new CrawlBudget(max_depth, max_pages, std::chrono::seconds(time_limit)));
+    }
+    SerialCrawl settings{base_url, robots, keep_query, sink.get(), dedup.get(), cache.get(), budget.get(), order};
+
     if (option_urlset == 0){
         SetList urlSet;
-        crawl(url, base_url, urlSet);
-        std::cout << "URLs found" << std::endl;
-        urlSet.display();
-        std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+        crawl(url, urlSet, settings);
+        finish(urlSet, settings);
     } else if (option_urlset == 1){
         CoarseHashTable<std::string> urlSet(32);
-        crawl(url, base_url, urlSet);
-        std::cout << "URLs found" << std::endl;
-        urlSet.display();
-        std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+        crawl(url, urlSet, settings);
+        finish(urlSet, settings);
     } else if (option_urlset == 2){
         StripedHashTable<std::string> urlSet(32);
-        crawl(url, base_url, urlSet);
-        std::cout << "URLs found" << std::endl;
-        urlSet.display();
-        std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+        crawl(url, urlSet, settings);
+        finish(urlSet, settings);
+    } else if (option_urlset == 3){
+        LockFreeHashTable urlSet(1024);
+        crawl(url, urlSet, settings);
+        finish(urlSet, settings);
+    } else if (option_urlset == 4){
+        MappedFingerprintSet urlSet(spill_dir + "/visited-" + std::to_string(getpid()) + ".fp", expected_urls);
+        if (!urlSet.isOpen()) return 1;
+        urlSet.limitResident((size_t) visited_memory << 20);
+        crawl(url, urlSet, settings);
+        finish(urlSet, settings);
     } else {
-        std::cerr << "Wrong url set option, please use 0 (SetList), 1 (CoarseHashTable) or 2 (StripedHashTable)" << std::endl;
+        std::cerr << "Wrong url set option, please use 0 (SetList), 1 (CoarseHashTable), 2 (StripedHashTable), 3 (LockFreeHashTable) or 4 (MappedFingerprintSet)" << std::endl;
         return 1;
     }
 
     auto stop = std::chrono::high_resolution_clock::now(); 
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
 	std::cout << "Execution time (seconds): ";
-	std::cout << duration.count()/1000/1000 << std::endl;
+	std::cout << duration.count()/1000/1000.0 << std::endl;
+    if (fetchConfig.latencies) {
+        fetchLatencies.report(std::cerr);
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,6 +1,6 @@
 #include <iostream>
 #include <string>
-#include <regex>
+#include <string_view>
 #include <vector>
 #include <curl/curl.h>
 #include <chrono>
@@ -9,132 +9,514 @@
 #include <condition_variable>
 #include <queue>
 
+#include "metrics.cpp"
+#include "urlarena.cpp"
 #include "hashtable.cpp"
+#include "bloomfilter.cpp"
+#include "contentdedup.cpp"
+#include "linkscanner.cpp"
+#include "urlnormalizer.cpp"
 #include "threadpool.cpp"
+#include "fetcher.cpp"
+#include "frontier.cpp"
+#include "scheduler.cpp"
+#include "robots.cpp"
+#include "checkpoint.cpp"
+#include "resultsink.cpp"
+#include "pagecache.cpp"
+#include "partition.cpp"
+#include "linkgraph.cpp"
 
-// Callback function to receive HTTP response
-size_t writeCallback(char* ptr, size_t size, size_t nmemb, std::string* data) {
-    data->append(ptr, size * nmemb);
-    return size * nmemb;
-}
+// State shared by all the tasks of a parallel crawl
+template <class T>
+struct CrawlContext {
+    std::string base_url;
+    T& urlSet;
+    ThreadPool& threadPool;
+    std::mutex& setMutex;
+    BloomFilter* filter; // URLs added to urlSet, nullptr if not filtered
+    Fetcher& fetcher;
+    HostScheduler* scheduler;
+    const RobotsRules* robots; // Rules of the site, nullptr to ignore its robots.txt
+    CrawlJournal* journal; // nullptr when not checkpointing
+    CrawlPartition* partition; // Owner of every URL in a distributed crawl, nullptr otherwise
+    ResultSink* sink; // Where the pages processed are written, nullptr to only display the URLs at the end
+    ContentDedup* dedup; // Content of the pages seen, nullptr to extract the links of every page
+    PageCache* cache; // Pages of the previous crawl, nullptr to fetch every page in full
+    CrawlBudget* budget; // Limits of the crawl, nullptr for none
+    LinkGraph* graph; // Links between the pages, nullptr when not recorded
+    bool stream;    // Extract the links on the fetch threads while the pages download
+    bool keepBody;  // Keep the whole pages in memory when streaming
+    bool keepQuery; // Keep the query of the URLs
+};
 
-// Function to check if URL exists
-bool urlExists(const std::string& url) {
-    CURL* curl;
-    CURLcode res;
-    long response_code = 0;
+// Options of the parallel crawl given on the command line
+struct CrawlOptions {
+    int num_threads;
+    int max_in_flight = 100;
+    int fetch_threads = 1;
+    bool stream = false;
+    bool discard_body = false;
+    int host_concurrency = 0;
+    int host_delay = 0; // milliseconds
+    bool ignore_robots = false;
+    int expected_urls = 0; // Size of the Bloom filter in front of the set, 0 for none
+    std::string spill_dir = "/tmp"; // Files of the frontier and of the mapped set
+    int visited_memory = 0; // MB of the table of the mapped set kept in memory, 0 for no limit
+    int frontier_memory = 0; // URLs of a host queue kept in memory before spilling to disk, 0 for no spilling
+    std::string checkpoint; // Journal of the crawl, empty for none
+    bool resume = false; // Continue the crawl recorded in checkpoint
+    int checkpoint_interval = 5; // seconds
+    bool keep_query = false;
+    std::vector<std::string> peers; // Addresses of all the processes of a distributed crawl, empty for none
+    int rank = 0; // Index of this process in peers
+    int metrics_interval = 0; // Seconds between two reports of the metrics on stderr, 0 for none
+    std::string metrics_file; // Prometheus text file of the metrics, empty for none
+    std::string output; // File the results are streamed to, empty to display the URLs at the end
+    ResultSink::Format output_format = ResultSink::JSONL;
+    bool dedup_content = false;
+    int simhash_distance = 3;
+    std::string cache; // Page cache of the previous crawl, to recrawl incrementally, empty for none
+    long max_depth = -1; // Links followed from the seed, negative for no limit
+    size_t max_pages = 0; // Pages fetched, 0 for no limit
+    int time_limit = 0; // Seconds, 0 for no limit
+    FrontierScore order = nullptr; // Of the host queues, nullptr for FIFO
+    std::string graph; // File the link graph is written to, empty for none
+    std::string pagerank; // File the ranks of the pages are written to, empty for none
+};
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    curl = curl_easy_init();
-
-    if(curl) {
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L); // We don't need the body
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); // Follow redirects
-
-        res = curl_easy_perform(curl);
-        
-        if(res == CURLE_OK) {
-            curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &response_code);
-            if(response_code == 200) {
-                curl_easy_cleanup(curl);
-                curl_global_cleanup();
-                return true;
-            }
+// Links of a page on their way to the set, normalized one after the other into a single buffer
+// and added together so that the set is locked once per batch rather than once per link
+struct PageBatch {
+    PageLinks links;
+    uint32_t depth; // Of the page, its links are one deeper
+    uint64_t source = 0; // Fingerprint of the page in the link graph
+    std::string urls;
+    std::vector<size_t> ends; // End of every URL in urls
+    bool keepOutlinks;
+    std::vector<std::string> outlinks; // Every link of the page to the site, if keepOutlinks (for the sink)
+    ContentHasher body; // Of the body streamed, with a page cache
+
+    PageBatch(const FrontierEntry& entry, bool keepQuery, bool keepOutlinks)
+        : links(entry.url, keepQuery), depth(entry.depth), keepOutlinks(keepOutlinks) {}
+
+    void push_back(const std::string& url) {
+        urls.append(url);
+        ends.push_back(urls.size());
+    }
+
+    std::vector<std::string_view> views() const {
+        std::vector<std::string_view> result;
+        result.reserve(ends.size());
+        for (size_t i = 0, start = 0; i < ends.size(); start = ends[i++]) {
+            result.emplace_back(urls.data() + start, ends[i] - start);
         }
-        curl_easy_cleanup(curl);
+        return result;
     }
-    curl_global_cleanup();
-    return false;
+
+    void clear() {
+        urls.clear();
+        ends.clear();
+    }
+};
+
+template <class T>
+void crawl_parallel(std::string url, uint32_t depth, CrawlContext<T>& ctx);
+template <class T>
+void schedule_url(const std::string& url, uint32_t depth, CrawlContext<T>& ctx);
+
+// Queue a link found on a page for the set if it is a URL of the site
+// The link is normalized in the buffer of the page and only copied to the batch of the page.
+// The new ones go straight to the scheduler queues (the frontier), no task is created for them.
+template <class T>
+void process_link(std::string_view link, PageBatch& page, CrawlContext<T>& ctx) {
+    metrics.add(LINKS_FOUND);
+    if (!page.links.resolve(link)) {
+        return;
+    }
+    // Keep only the URLs of the site being crawled
+    if (page.links.normalizer.origin() != ctx.base_url) {
+        return;
+    }
+    const std::string& url2 = page.links.normalizer.url();
+    if (page.keepOutlinks) page.outlinks.push_back(url2);
+    if (ctx.graph) ctx.graph->addLink(page.source, url2);
+    if (ctx.robots && !ctx.robots->allowed(pathOf(url2))) {
+        return;
+    }
+    if (ctx.budget && !ctx.budget->allowsDepth(page.depth + 1)) {
+        return;
+    }
+    // The URLs owned by another process are its to look up and crawl
+    if (ctx.partition && !ctx.partition->owns(url2)) {
+        ctx.partition->forward(url2, page.depth + 1);
+        return;
+    }
+
+    // A URL the filter has never seen is new, only the probable duplicates are batched for the set
+    if (ctx.filter && !ctx.filter->mayContain(url2)) {
+        crawl_parallel(url2, page.depth + 1, ctx);
+        return;
+    }
+    page.push_back(url2);
 }
 
-// Function to fetch HTML content from a URL
-std::string fetchHTML(const std::string& url) {
-    CURL* curl = curl_easy_init();
-    if (curl) {
-        std::string data;
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeCallback);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
-        curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); // Follow redirects
-        curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);
-        CURLcode res = curl_easy_perform(curl);
-        if (res != CURLE_OK) {
-            // std::cerr << "Failed to fetch URL: " << curl_easy_strerror(res) << std::endl;
-            return ""; // Return empty string to indicate failure
+// Add the links batched for a page to the set and crawl the new ones
+template <class T>
+void add_links(PageBatch& page, CrawlContext<T>& ctx) {
+    if (page.ends.empty()) {
+        return;
+    }
+    std::vector<std::string_view> urls = page.views();
+    std::vector<bool> added;
+    {
+        ScopedTimer timer(SET_INSERT_NS);
+        std::unique_lock<std::mutex> lock(ctx.setMutex, std::defer_lock);
+        if (!is_concurrent_set<T>::value) lockTimed(lock, SET_LOCK_WAIT_NS);
+        added = ctx.urlSet.addURLs(urls);
+    }
+    for (size_t i = 0; i < urls.size(); i++) {
+        if (added[i]) schedule_url(std::string(urls[i]), page.depth + 1, ctx);
+    }
+    page.clear();
+}
+
+// Take the links of a page from the cache if it did not change since the previous crawl
+template <class T>
+bool reuse_links(const FetchResult& result, uint64_t hash, PageBatch& page, CrawlContext<T>& ctx) {
+    std::vector<std::string> cached;
+    if (!ctx.cache || !ctx.cache->unchanged(page.links.url, result, hash, cached)) {
+        return false;
+    }
+    metrics.add(UNCHANGED_PAGES);
+    for (const std::string& link : cached) {
+        process_link(link, page, ctx);
+    }
+    add_links(page, ctx);
+    return true;
+}
+
+// Parallel function to extract URLs from the HTML content of the page of entry, then write its result
+template <class T>
+void extract_links(const std::string& html, const FrontierEntry& entry, const FetchResult& result, CrawlContext<T>& ctx) {
+    PageBatch page(entry, ctx.keepQuery, ctx.sink || ctx.cache);
+    // The links of a page seen under another URL have been followed already
+    if (ctx.dedup && !html.empty() && ctx.dedup->duplicate(html)) {
+        metrics.add(DUPLICATE_PAGES);
+        if (ctx.sink) ctx.sink->record(entry.url, result, entry.depth, page.outlinks);
+        return;
+    }
+    if (ctx.graph) page.source = ctx.graph->addPage(entry.url);
+    uint64_t hash = ctx.cache && !html.empty() ? ContentDedup::contentHash(html) : 0;
+    if (!reuse_links(result, hash, page, ctx)) {
+        {
+            ScopedTimer timer(PARSE_NS);
+            page.links.scanner.scan(html.data(), html.size(), [&page, &ctx](std::string_view link) {
+                process_link(link, page, ctx);
+            });
         }
-        curl_easy_cleanup(curl);
-        return data;
-    } else {
-        std::cerr << "Failed to initialize CURL" << std::endl;
-        return "";
+        add_links(page, ctx);
+        if (ctx.cache && result.status >= 200 && result.status < 300) {
+            ctx.cache->update(entry.url, result, hash, page.outlinks);
+        }
+    }
+    if (ctx.sink) ctx.sink->record(entry.url, result, entry.depth, page.outlinks);
+}
+
+// Fetch a page released by the scheduler: the page is fetched asynchronously by the Fetcher
+// and its links are extracted by a ThreadPool task once it has arrived,
+// or while it arrives by the fetch thread in streaming mode
+// With a page cache, the request is conditional and an unchanged page is not parsed
+template <class T>
+void fetch_page(const FrontierEntry& entry, CrawlContext<T>& ctx) {
+    const std::string& url = entry.url;
+    Validators conditional = ctx.cache ? ctx.cache->validators(url) : Validators();
+    if (ctx.stream) {
+        std::shared_ptr<PageBatch> page = std::make_shared<PageBatch>(entry, ctx.keepQuery, ctx.sink || ctx.cache);
+        if (ctx.graph) page->source = ctx.graph->addPage(url);
+        ctx.fetcher.fetch(url, [url, page, &ctx](std::string& html, const FetchResult& result) {
+            ctx.scheduler->done(url);
+            // The links of a body were extracted while it arrived, only those of a 304 come from the cache
+            if (ctx.cache) {
+                uint64_t hash = page->body.bytes() > 0 ? page->body.finish() : 0;
+                std::vector<std::string> cached;
+                if (hash != 0 && ctx.cache->unchanged(url, result, hash, cached)) {
+                    metrics.add(UNCHANGED_PAGES);
+                } else if ((hash != 0 || !reuse_links(result, 0, *page, ctx)) && result.status >= 200 && result.status < 300) {
+                    ctx.cache->update(url, result, hash, page->outlinks);
+                }
+            }
+            if (ctx.sink) ctx.sink->record(url, result, page->depth, page->outlinks);
+            if (ctx.journal) ctx.journal->finished(url);
+            ctx.threadPool.release_hold();
+        }, [page, &ctx](const char* data, size_t size) {
+            if (ctx.cache) page->body.update(data, size);
+            {
+                ScopedTimer timer(PARSE_NS);
+                page->links.scanner.feed(data, size, [&page, &ctx](std::string_view link) {
+                    process_link(link, *page, ctx);
+                });
+            }
+            add_links(*page, ctx);
+        }, ctx.keepBody, conditional);
+        return;
     }
+    ctx.fetcher.fetch(url, [entry, &ctx](std::string& html, const FetchResult& result) {
+        ctx.scheduler->done(entry.url);
+        if (!html.empty() || (ctx.cache && result.status == 304)) {
+            std::shared_ptr<std::string> page = std::make_shared<std::string>(std::move(html));
+            ctx.threadPool.add_task_to_queue([entry, page, result, &ctx]() {
+                extract_links(*page, entry, result, ctx);
+                if (ctx.journal) ctx.journal->finished(entry.url);
+            });
+        } else {
+            if (ctx.sink) ctx.sink->record(entry.url, result, entry.depth, std::vector<std::string>());
+            if (ctx.journal) ctx.journal->finished(entry.url);
+        }
+        ctx.threadPool.release_hold();
+    }, nullptr, true, conditional);
 }
 
-// Parallel function to extract URLs from crawling the HTML content using regex
+// Parallel crawl of a URL: a new URL waits in the scheduler until its host can take
+// another request, the pool is held until its page has been fetched
 template <class T>
-void crawl_parallel(std::string url, const std::string& base_url, T& urlSet, ThreadPool& threadPool, std::mutex& setMutex) {
+void crawl_parallel(std::string url, uint32_t depth, CrawlContext<T>& ctx) {
     {
-        std::lock_guard<std::mutex> lock(setMutex);
-        if (!urlSet.addURL(url)) {
+        // The lock-free and hash table sets are safe on their own, the others are serialized by setMutex
+        ScopedTimer timer(SET_INSERT_NS);
+        std::unique_lock<std::mutex> lock(ctx.setMutex, std::defer_lock);
+        if (!is_concurrent_set<T>::value) lockTimed(lock, SET_LOCK_WAIT_NS);
+        if (!ctx.urlSet.addURL(url)) {
             return;
         }
     }
+    schedule_url(url, depth, ctx);
+}
 
-    std::string html = fetchHTML(url);
-    if (html.empty()) {
-        return;
+// Record a URL just added to the set and queue it for its host, the pool is held until its page has been fetched
+template <class T>
+void schedule_url(const std::string& url, uint32_t depth, CrawlContext<T>& ctx) {
+    metrics.add(URLS_ADDED);
+    if (ctx.filter) ctx.filter->add(url);
+    if (ctx.journal) ctx.journal->added(url, depth);
+
+    ctx.threadPool.hold();
+    ctx.scheduler->push(url, depth);
+}
+
+// Crawl from url until no page is left, then display the URLs found unless they were streamed to a file
+// false if the crawl could not start (its files could not be opened, its URL is disallowed)
+template <class T>
+bool run_crawl(T& urlSet, const std::string& url, const std::string& base_url, const CrawlOptions& options) {
+    // Outlive the fetches and tasks which record in them
+    std::unique_ptr<CrawlJournal> journal;
+    std::unique_ptr<ResultSink> sink;
+    std::unique_ptr<LinkGraph> graph;
+    if (!options.graph.empty() || !options.pagerank.empty()) {
+        graph.reset(new LinkGraph());
     }
-    // Regular expression to find URLs in HTML
-    std::regex urlRegex(R"(href=["']([^"']+)["'])");
-    auto words_begin = std::sregex_iterator(html.begin(), html.end(), urlRegex);
-    auto words_end = std::sregex_iterator();
-    for (std::sregex_iterator i = words_begin; i != words_end; ++i) {
-        std::smatch match = *i;
-        std::string url2 = match[1].str();
-
-        // To ensure that the URL starts with the base URL
-        if (url2.find(base_url) != 0) {
-            if (url2.find('#') != std::string::npos 
-                || url2.find("//") != std::string::npos 
-                || url2.find(":") != std::string::npos 
-                || url2.find("{") != std::string::npos){
-                continue; // Pass if the url is an id on the page (#), another protocol (// or :) or a script ({)
-            }else if (url2.find('/') == 0) { // Relative url 
-                url2 = base_url + url2;
-            } else if (url2.find('/') == std::string::npos){ // relative url
-                url2 = base_url + '/' + url2;
-            } else {
-                continue;
-            }
+    Fetcher fetcher(options.fetch_threads, options.max_in_flight);
+    ThreadPool threadPool(options.num_threads);
+    std::mutex setMutex;
+    // The lock-free set is cheaper to look up than the filter
+    std::unique_ptr<BloomFilter> filter;
+    if (options.expected_urls > 0 && !is_lock_free_set<T>::value) {
+        filter.reset(new BloomFilter(options.expected_urls));
+    }
+    std::unique_ptr<ContentDedup> dedup;
+    if (options.dedup_content) {
+        dedup.reset(new ContentDedup(options.simhash_distance));
+    }
+    std::unique_ptr<PageCache> cache;
+    if (!options.cache.empty()) {
+        cache.reset(new PageCache(options.cache));
+        if (!cache->load()) return false;
+    }
+    std::unique_ptr<CrawlBudget> budget;
+    if (options.max_depth >= 0 || options.max_pages > 0 || options.time_limit > 0) {
+        budget.reset(new CrawlBudget(options.max_depth, options.max_pages, std::chrono::seconds(options.time_limit)));
+    }
+    RobotsCache robotsCache(ROBOTS_AGENT);
+    CrawlContext<T> ctx{base_url, urlSet, threadPool, setMutex, filter.get(), fetcher, nullptr, nullptr, nullptr, nullptr,
+                        nullptr, dedup.get(), cache.get(), budget.get(), graph.get(), options.stream, !options.discard_body,
+                        options.keep_query};
+    // The fetcher only gets what it can transfer at once, the rest of the frontier waits in the scheduler
+    // The URLs it will never dispatch (budget exhausted, spill segment lost) release their hold on the
+    // pool, a resumed crawl would fetch them
+    HostScheduler scheduler(options.host_concurrency, std::chrono::milliseconds(options.host_delay),
+                            (size_t) options.max_in_flight * options.fetch_threads,
+                            [&ctx](const FrontierEntry& e) { fetch_page(e, ctx); },
+                            [&threadPool](size_t count) {
+                                for (size_t i = 0; i < count; i++) threadPool.release_hold();
+                            },
+                            options.frontier_memory > 0 ? options.spill_dir : "", options.frontier_memory);
+    ctx.scheduler = &scheduler;
+    scheduler.setOrder(options.order);
+    if (budget) scheduler.setBudget(budget.get());
+    // Listen before anything else so that the peers can connect while this process starts
+    std::unique_ptr<CrawlPartition> partition;
+    if (!options.peers.empty()) {
+        partition.reset(new CrawlPartition(options.peers, options.rank));
+        ctx.partition = partition.get();
+    }
+
+    // Only the base host is crawled, so its robots.txt is fetched once before starting
+    if (!options.ignore_robots) {
+        ctx.robots = &robotsCache.rulesFor(base_url);
+        if (!ctx.robots->allowed(pathOf(url))) {
+            std::cerr << "URL disallowed by robots.txt: " << url << std::endl;
+            return false;
         }
-        if (url2.find('#') != std::string::npos){ // Remove ids on page
-            url2 = url2.substr(0, url2.find("#"));
+        if (ctx.robots->getCrawlDelay() > std::chrono::milliseconds(options.host_delay)) {
+            scheduler.setDelay(base_url, ctx.robots->getCrawlDelay());
         }
-        if (url2.find('?') != std::string::npos){  // Remove arguments on page
-            url2 = url2.substr(0, url2.find("?"));
+    }
+
+    // Last declared so that it is stopped before what its gauges read
+    std::unique_ptr<MetricsReporter> reporter;
+    if (options.metrics_interval > 0 || !options.metrics_file.empty()) {
+        reporter.reset(new MetricsReporter(std::chrono::seconds(options.metrics_interval > 0 ? options.metrics_interval : 5),
+                                           options.metrics_interval > 0, options.metrics_file));
+        reporter->addGauge("crawler_frontier_urls", "URLs waiting to be fetched", [&scheduler]() {
+            return (double) scheduler.size();
+        });
+        reporter->addGauge("crawler_fetches_in_flight", "Transfers in progress", [&scheduler]() {
+            return (double) scheduler.dispatched();
+        });
+        reporter->addGauge("crawler_queued_tasks", "Pages waiting for a thread to extract their links", [&threadPool]() {
+            return (double) threadPool.queued_tasks();
+        });
+        reporter->addGauge("crawler_urls_found", "URLs in the set", [&urlSet, &setMutex]() {
+            std::unique_lock<std::mutex> lock(setMutex, std::defer_lock);
+            if (!is_concurrent_set<T>::value) lock.lock();
+            return (double) urlSet.getSize();
+        });
+        reporter->start();
+    }
+
+    // Reload the URLs found by the interrupted crawl and fetch again the pages it had not finished
+    std::vector<FrontierEntry> frontier;
+    if (options.resume) {
+        bool loaded = CrawlJournal::load(options.checkpoint, [&urlSet, &filter](const std::string& u) {
+            urlSet.addURL(u);
+            if (filter) filter->add(u);
+        }, frontier);
+        if (!loaded) return false;
+        std::cout << "Resumed " << urlSet.getSize() << " URLs, " << frontier.size() << " to fetch" << std::endl;
+    }
+    if (!options.checkpoint.empty()) {
+        journal.reset(new CrawlJournal(options.checkpoint, std::chrono::seconds(options.checkpoint_interval), options.resume));
+        if (!journal->isOpen()) return false;
+        ctx.journal = journal.get();
+    }
+    if (!options.output.empty()) {
+        sink.reset(new ResultSink(options.output, options.output_format, std::chrono::seconds(1), options.resume));
+        if (!sink->isOpen()) return false;
+        ctx.sink = sink.get();
+    }
+
+    // A journal interrupted before its first write starts over from the seed
+    if (options.resume && urlSet.getSize() > 0) {
+        for (const FrontierEntry& e : frontier) {
+            threadPool.hold();
+            scheduler.push(e.url, e.depth);
         }
+    } else if (!partition || partition->owns(url)) {
+        threadPool.add_task_to_queue([url, &ctx]() {
+            crawl_parallel(url, 0, ctx);
+        });
+    }
 
-        {
-            std::lock_guard<std::mutex> lock(setMutex);
-            if (!urlSet.containsURL(url2)) {
-                threadPool.add_task_to_queue([url2, base_url, &urlSet, &threadPool, &setMutex]() {
-                    crawl_parallel(url2, base_url, urlSet, threadPool, setMutex);
-                });
-            }
+    // Once distributed, being idle is not the end: the other processes may still send URLs
+    bool complete = true;
+    if (partition) {
+        complete = partition->start([&ctx](const std::string& u, uint32_t depth) {
+            crawl_parallel(u, depth, ctx);
+        }, [&threadPool]() {
+            return threadPool.is_idle();
+        }, [&urlSet, &setMutex]() {
+            std::unique_lock<std::mutex> lock(setMutex, std::defer_lock);
+            if (!is_concurrent_set<T>::value) lock.lock();
+            return (size_t) urlSet.getSize();
+        }) && partition->waitForTermination();
+    }
+    threadPool.wait_idle();
+    if (scheduler.dropped() > 0) {
+        std::cout << "Crawl budget exhausted, " << scheduler.dropped() << " URLs were not fetched" << std::endl;
+    }
+    if (scheduler.lost() > 0) {
+        std::cerr << scheduler.lost() << " URLs of the frontier were lost, the crawl is incomplete" << std::endl;
+    }
+    if (cache) cache->save();
+    if (graph) {
+        graph->build();
+        std::cout << "Link graph: " << graph->numPages() << " pages, " << graph->numLinks() << " links" << std::endl;
+        if (!options.graph.empty()) graph->write(options.graph);
+        if (!options.pagerank.empty()) {
+            std::vector<double> ranks;
+            std::vector<uint32_t> inlinks;
+            int iterations = graph->pageRank(threadPool, options.num_threads, ranks, inlinks);
+            std::cout << "PageRank: " << iterations << " iterations" << std::endl;
+            graph->writeRanks(options.pagerank, ranks, inlinks);
         }
     }
+    if (!sink) {
+        std::cout << "URLs found" << std::endl;
+        urlSet.display();
+    }
+    std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+    if (partition && options.rank == 0 && complete) {
+        std::cout << "Total number of URLs: " << partition->getTotalFound() << std::endl;
+    } else if (!complete) {
+        std::cerr << "The distributed crawl did not complete" << std::endl;
+    }
+    return true;
 }
 
 int main(int argc, char* argv[]) {
 
-    if (argc != 4){
+    if (argc < 4){
         std::cerr << "Invalid command, please give your command as:" << std::endl;
-        std::cerr << "./webcrawler <opt_set> <url> <num_threads>" << std::endl;
-        std::cerr << "opt_set being 0 (SetList), 1 (CoarseHashTable), or 2 (StripedHashTable)" << std::endl;
-        std::cerr << "\t\t defining the set you want to use to store the URLs" << std::endl;
+        std::cerr << "./webcrawler_parallel <opt_set> <url> <num_threads> [options]" << std::endl;
+        std::cerr << "opt_set being 0 (SetList), 1 (CoarseHashTable), 2 (StripedHashTable), 3 (LockFreeHashTable)" << std::endl;
+        std::cerr << "\t\t or 4 (MappedFingerprintSet) defining the set you want to use to store the URLs" << std::endl;
         std::cerr << "url being the URL you want to crawl" << std::endl;
         std::cerr << "num_threads being the number of threads to use" << std::endl;
+        std::cerr << "options being any of:" << std::endl;
+        std::cerr << "\t--max-in-flight <n>\t maximum number of concurrent transfers per fetch thread (default 100)" << std::endl;
+        std::cerr << "\t--fetch-threads <n>\t number of threads driving the transfers (default 1)" << std::endl;
+        std::cerr << "\t--fetch-latency\t\t print the median and 99th percentile of the fetch durations" << std::endl;
+        std::cerr << "\t--max-page-size <bytes>\t abandon the pages larger than bytes (default 10 MB, 0 for no limit)" << std::endl;
+        std::cerr << "\t--all-content-types\t download the pages whatever their Content-Type, not only HTML" << std::endl;
+        std::cerr << "\t--http2\t\t\t negotiate HTTP/2 and multiplex the transfers on one connection" << std::endl;
+        std::cerr << "\t--stream\t\t extract the links on the fetch threads while the pages download" << std::endl;
+        std::cerr << "\t--discard-body\t\t with --stream, do not keep the pages in memory" << std::endl;
+        std::cerr << "\t--host-concurrency <n>\t maximum number of concurrent requests to a host (default no limit)" << std::endl;
+        std::cerr << "\t--host-delay <ms>\t minimum time between two requests to a host (default 0)" << std::endl;
+        std::cerr << "\t--ignore-robots\t\t do not fetch nor respect the robots.txt of the site" << std::endl;
+        std::cerr << "\t--expected-urls <n>\t put a Bloom filter sized for n URLs in front of sets 0, 1, 2 and 4, and size the table of set 4 for them" << std::endl;
+        std::cerr << "\t--frontier-memory <n>\t keep n URLs per host in memory and spill the rest of the frontier to disk" << std::endl;
+        std::cerr << "\t--spill-dir <dir>\t directory of the frontier files and of the set 4 (default /tmp)" << std::endl;
+        std::cerr << "\t--visited-memory <MB>\t keep at most about MB of the table of the set 4 in memory (default no limit)" << std::endl;
+        std::cerr << "\t--checkpoint <file>\t record the progress of the crawl in file to be able to resume it" << std::endl;
+        std::cerr << "\t--checkpoint-interval <s>\t seconds between two writes of the checkpoint (default 5)" << std::endl;
+        std::cerr << "\t--resume <file>\t\t resume the crawl recorded in file, and keep recording in it" << std::endl;
+        std::cerr << "\t--keep-query\t\t keep the query of the URLs instead of removing it" << std::endl;
+        std::cerr << "\t--metrics <s>\t\t print the metrics of the crawl on stderr every s seconds" << std::endl;
+        std::cerr << "\t--metrics-file <file>\t write the metrics in the Prometheus text format to file" << std::endl;
+        std::cerr << "\t--output <file>\t\t stream a record of every page to file instead of displaying the URLs at the end" << std::endl;
+        std::cerr << "\t--output-format <f>\t format of the records, jsonl (default) or binary" << std::endl;
+        std::cerr << "\t--cache <file>\t\t recrawl incrementally: fetch the pages of the previous crawl recorded in file only if they changed" << std::endl;
+        std::cerr << "\t--dedup-content\t\t do not follow the links of pages with the same content as a page seen" << std::endl;
+        std::cerr << "\t--simhash-distance <k>\t with --dedup-content, pages within k bits of SimHash are the same (default 3, 0 to 7)" << std::endl;
+        std::cerr << "\t--max-depth <n>\t\t do not crawl the URLs more than n links away from the seed" << std::endl;
+        std::cerr << "\t--max-pages <n>\t\t stop fetching after n pages" << std::endl;
+        std::cerr << "\t--time-limit <s>\t stop fetching after s seconds, the transfers in flight finish" << std::endl;
+        std::cerr << "\t--order <o>\t\t order of the URLs of a host: fifo (default), depth (breadth first) or url-length (shortest first)" << std::endl;
+        std::cerr << "\t--graph <file>\t\t write the link graph of the pages to file in compressed sparse row form" << std::endl;
+        std::cerr << "\t--pagerank <file>\t write the pages by decreasing PageRank with their number of inlinks to file" << std::endl;
+        std::cerr << "\t--peers <h:p,...>\t addresses of all the processes of a distributed crawl" << std::endl;
+        std::cerr << "\t--rank <i>\t\t index of this process in the peers (default 0)" << std::endl;
         return 1;
     }
 
@@ -142,66 +524,165 @@ int main(int argc, char* argv[]) {
 
     int option_urlset = std::stoi(argv[1]);
     std::string url = argv[2];
-    int num_threads = std::stoi(argv[3]);
+    CrawlOptions options;
+    options.num_threads = std::stoi(argv[3]);
+    for (int i = 4; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--max-in-flight" && i + 1 < argc) {
+            options.max_in_flight = std::stoi(argv[++i]);
+        } else if (option == "--fetch-threads" && i + 1 < argc) {
+            options.fetch_threads = std::stoi(argv[++i]);
+        } else if (option == "--fetch-latency") {
+            fetchConfig.latencies = true;
+        } else if (option == "--max-page-size" && i + 1 < argc) {
+            fetchConfig.maxBytes = std::stoll(argv[++i]);
+        } else if (option == "--all-content-types") {
+            fetchConfig.htmlOnly = false;
+        } else if (option == "--http2") {
+            fetchConfig.http2 = true;
+        } else if (option == "--stream") {
+            options.stream = true;
+        } else if (option == "--discard-body") {
+            options.discard_body = true;
+        } else if (option == "--host-concurrency" && i + 1 < argc) {
+            options.host_concurrency = std::stoi(argv[++i]);
+        } else if (option == "--host-delay" && i + 1 < argc) {
+            options.host_delay = std::stoi(argv[++i]);
+        } else if (option == "--ignore-robots") {
+            options.ignore_robots = true;
+        } else if (option == "--expected-urls" && i + 1 < argc) {
+            options.expected_urls = std::stoi(argv[++i]);
+        } else if (option == "--frontier-memory" && i + 1 < argc) {
+            options.frontier_memory = std::stoi(argv[++i]);
+        } else if (option == "--spill-dir" && i + 1 < argc) {
+            options.spill_dir = argv[++i];
+        } else if (option == "--visited-memory" && i + 1 < argc) {
+            options.visited_memory = std::stoi(argv[++i]);
+        } else if (option == "--checkpoint" && i + 1 < argc) {
+            options.checkpoint = argv[++i];
+        } else if (option == "--checkpoint-interval" && i + 1 < argc) {
+            options.checkpoint_interval = std::stoi(argv[++i]);
+        } else if (option == "--resume" && i + 1 < argc) {
+            options.checkpoint = argv[++i];
+            options.resume = true;
+        } else if (option == "--keep-query") {
+            options.keep_query = true;
+        } else if (option == "--metrics" && i + 1 < argc) {
+            options.metrics_interval = std::stoi(argv[++i]);
+        } else if (option == "--metrics-file" && i + 1 < argc) {
+            options.metrics_file = argv[++i];
+        } else if (option == "--output" && i + 1 < argc) {
+            options.output = argv[++i];
+        } else if (option == "--output-format" && i + 1 < argc) {
+            std::string format = argv[++i];
+            if (format == "jsonl") {
+                options.output_format = ResultSink::JSONL;
+            } else if (format == "binary") {
+                options.output_format = ResultSink::BINARY;
+            } else {
+                std::cerr << "Unknown output format " << format << ", please use jsonl or binary" << std::endl;
+                return 1;
+            }
+        } else if (option == "--cache" && i + 1 < argc) {
+            options.cache = argv[++i];
+        } else if (option == "--dedup-content") {
+            options.dedup_content = true;
+        } else if (option == "--simhash-distance" && i + 1 < argc) {
+            options.simhash_distance = std::stoi(argv[++i]);
+        } else if (option == "--max-depth" && i + 1 < argc) {
+            options.max_depth = std::stol(argv[++i]);
+        } else if (option == "--max-pages" && i + 1 < argc) {
+            options.max_pages = std::stoul(argv[++i]);
+        } else if (option == "--time-limit" && i + 1 < argc) {
+            options.time_limit = std::stoi(argv[++i]);
+        } else if (option == "--order" && i + 1 < argc) {
+            std::string order = argv[++i];
+            if (!parseCrawlOrder(order, options.order)) {
+                std::cerr << "Unknown order " << order << ", please use fifo, depth or url-length" << std::endl;
+                return 1;
+            }
+        } else if (option == "--graph" && i + 1 < argc) {
+            options.graph = argv[++i];
+        } else if (option == "--pagerank" && i + 1 < argc) {
+            options.pagerank = argv[++i];
+        } else if (option == "--peers" && i + 1 < argc) {
+            std::string list = argv[++i];
+            for (size_t start = 0; start <= list.size(); ) {
+                size_t comma = std::min(list.find(',', start), list.size());
+                options.peers.push_back(list.substr(start, comma - start));
+                start = comma + 1;
+            }
+        } else if (option == "--rank" && i + 1 < argc) {
+            options.rank = std::stoi(argv[++i]);
+        } else {
+            std::cerr << "Unknown option " << option << std::endl;
+            return 1;
+        }
+    }
 
-    // Keep only url starting like first one in order to avoid crawling the whole internet (ex. redirects to instagram.com ...)!
-    std::regex baseUrlRegex(R"((https?://[^/]+))");
-    std::smatch baseUrlMatch;
-    std::string base_url;
-    if (std::regex_search(url, baseUrlMatch, baseUrlRegex)) {
-        base_url = baseUrlMatch[1].str();
-    } else {
-        std::cerr << "Failed to extract base URL." << std::endl;
+    if (options.simhash_distance < 0 || options.simhash_distance > 7) {
+        std::cerr << "The SimHash distance must be between 0 and 7" << std::endl;
+        return 1;
+    }
+    if (options.dedup_content && options.stream) {
+        std::cerr << "--dedup-content needs the whole page before extracting its links, it cannot be used with --stream" << std::endl;
+        return 1;
+    }
+    if (options.order && options.frontier_memory > 0) {
+        std::cerr << "A frontier spilled to disk is FIFO, --order cannot be used with --frontier-memory" << std::endl;
+        return 1;
+    }
+    if (!options.peers.empty() && (!options.graph.empty() || !options.pagerank.empty())) {
+        std::cerr << "The link graph of a distributed crawl is split between its processes, --graph and --pagerank cannot be used with --peers" << std::endl;
+        return 1;
+    }
+    if (!options.peers.empty() && (options.rank < 0 || options.rank >= (int) options.peers.size())) {
+        std::cerr << "The rank must be the index of this process in the peers" << std::endl;
         return 1;
     }
-    std::cout << "Base URL: " << base_url << std::endl;
 
-    // Validate the URL format
-    std::regex urlFormat(R"(https?://\S+)");
-    if (!std::regex_match(url, urlFormat)) {
+    // Keep only url starting like first one in order to avoid crawling the whole internet (ex. redirects to instagram.com ...)!
+    UrlNormalizer normalizer(options.keep_query);
+    if (!normalizer.normalize(url)) {
         std::cerr << "Invalid URL format. Please enter a valid URL starting with http:// or https://" << std::endl;
         return 1;
     }
+    url = normalizer.url();
+    std::string base_url(normalizer.origin());
+    std::cout << "Base URL: " << base_url << std::endl;
 
-    ThreadPool* threadPool = new ThreadPool(num_threads);
-    std::mutex setMutex;
+    curl_global_init(CURL_GLOBAL_DEFAULT);
 
     if (option_urlset == 0){
         SetList urlSet;
-        threadPool->add_task_to_queue([url, base_url, &urlSet, &threadPool, &setMutex]() {
-            crawl_parallel(url, base_url, urlSet, *threadPool, setMutex);
-        });
-        delete threadPool;
-        std::cout << "URLs found" << std::endl;
-        urlSet.display();
-        std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+        if (!run_crawl(urlSet, url, base_url, options)) return 1;
     } else if (option_urlset == 1){
         CoarseHashTable<std::string> urlSet(32);
-        threadPool->add_task_to_queue([url, base_url, &urlSet, &threadPool, &setMutex]() {
-            crawl_parallel(url, base_url, urlSet, *threadPool, setMutex);
-        });
-        delete threadPool;
-        std::cout << "URLs found" << std::endl;
-        urlSet.display();
-        std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+        if (!run_crawl(urlSet, url, base_url, options)) return 1;
     } else if (option_urlset == 2){
         StripedHashTable<std::string> urlSet(32);
-        threadPool->add_task_to_queue([url, base_url, &urlSet, &threadPool, &setMutex]() {
-            crawl_parallel(url, base_url, urlSet, *threadPool, setMutex);
-        });
-        delete threadPool;
-        std::cout << "URLs found" << std::endl;
-        urlSet.display();
-        std::cout << "Number of URLs: " << urlSet.getSize() << std::endl;
+        if (!run_crawl(urlSet, url, base_url, options)) return 1;
+    } else if (option_urlset == 3){
+        LockFreeHashTable urlSet(1024);
+        if (!run_crawl(urlSet, url, base_url, options)) return 1;
+    } else if (option_urlset == 4){
+        MappedFingerprintSet urlSet(options.spill_dir + "/visited-" + std::to_string(getpid()) + ".fp",
+                                    options.expected_urls > 0 ? options.expected_urls : 1024);
+        if (!urlSet.isOpen()) return 1;
+        urlSet.limitResident((size_t) options.visited_memory << 20);
+        if (!run_crawl(urlSet, url, base_url, options)) return 1;
     } else {
-        std::cerr << "Wrong url set option, please use 0 (SetList), 1 (CoarseHashTable) or 2 (StripedHashTable)" << std::endl;
+        std::cerr << "Wrong url set option, please use 0 (SetList), 1 (CoarseHashTable), 2 (StripedHashTable), 3 (LockFreeHashTable) or 4 (MappedFingerprintSet)" << std::endl;
         return 1;
     }
 
     auto stop = std::chrono::high_resolution_clock::now(); 
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(stop - start);
 	std::cout << "Execution time (seconds): ";
-	std::cout << duration.count()/1000/1000 << std::endl;
+	std::cout << duration.count()/1000/1000.0 << std::endl;
+    if (fetchConfig.latencies) {
+        fetchLatencies.report(std::cerr);
+    }
 
     return 0;
 }